@@ -2,19 +2,19 @@
 
   elf.c
 
-  Embedded ARM ELF32 loader
+  Embedded ARM ELF32 / AArch64 ELF64 loader
 
 */
 
 /*
 
-  ELF32
+  ELF32 / ELF64
 
   Definitions based on "sys/elf.h"
 
 */
 
-#include <stdint.h> /* uint8_t uint16_t uint32_t int32_t uintptr_t */
+#include <stdint.h> /* uint8_t uint16_t uint32_t int32_t uint64_t int64_t uintptr_t */
 
 #define EI_CLASS   ( 4 )
 #define EI_DATA    ( 5 )
@@ -22,12 +22,18 @@
 #define EI_NIDENT  ( 16 )
 
 #define ELFCLASS32  ( 1 )
+#define ELFCLASS64  ( 2 )
 #define ELFDATA2LSB ( 1 )
 #define ET_DYN      ( 3 )
 
+#define EM_ARM     ( 40 )
+#define EM_AARCH64 ( 183 )
+
 #define PT_LOAD    ( 1 )
 #define PT_DYNAMIC ( 2 )
 
+#define PF_X ( 0x1 )
+
 #define DT_NULL         ( 0 )
 #define DT_NEEDED       ( 1 )
 #define DT_PLTRELSZ     ( 2 )
@@ -56,6 +62,8 @@
 #define DT_INIT_ARRAYSZ ( 0x1b )
 #define DT_FINI_ARRAY   ( 0x1a )
 #define DT_FINI_ARRAYSZ ( 0x1c )
+#define DT_RELACOUNT    ( 0x6ffffff9 )
+#define DT_RELCOUNT     ( 0x6ffffffa )
 #define DT_LOPROC       ( 0x70000000 )
 #define DT_HIPROC       ( 0x7fffffff )
 
@@ -66,6 +74,9 @@
 #define STB_GLOBAL ( 1 )
 #define STB_WEAK   ( 2 )
 
+#define STT_OBJECT ( 1 )
+#define STT_FUNC   ( 2 )
+
 typedef uint16_t Elf32_Half;
 typedef uint32_t Elf32_Word, Elf32_Off, Elf32_Addr;
 typedef int32_t Elf32_Sword;
@@ -121,14 +132,83 @@ typedef struct {
   Elf32_Word r_info;
 } Elf32_Rel;
 
-#define ELF32_PH_GET( header, index )       ( ( Elf32_Phdr * )( ( uintptr_t )( header ) + ( header )->e_phoff + ( header )->e_phentsize * ( index ) ) )
-#define ELF32_PH_CONTENT( header, section ) ( ( uintptr_t )( header ) + ( section )->p_offset )
-
-#define ELF32_ST_BIND( info ) ( ( info ) >> 4 )
+typedef struct {
+  Elf32_Addr  r_offset;
+  Elf32_Word  r_info;
+  Elf32_Sword r_addend;
+} Elf32_Rela;
 
 #define ELF32_R_SYM( info )  ( ( info ) >> 8 )
 #define ELF32_R_TYPE( info ) ( ( uint8_t )( info ) )
 
+typedef uint16_t Elf64_Half;
+typedef uint32_t Elf64_Word;
+typedef uint64_t Elf64_Xword, Elf64_Off, Elf64_Addr;
+typedef int64_t Elf64_Sxword;
+
+typedef struct {
+  uint8_t    e_ident[EI_NIDENT];
+  Elf64_Half e_type;
+  Elf64_Half e_machine;
+  Elf64_Word e_version;
+  Elf64_Addr e_entry;
+  Elf64_Off  e_phoff;
+  Elf64_Off  e_shoff;
+  Elf64_Word e_flags;
+  Elf64_Half e_ehsize;
+  Elf64_Half e_phentsize;
+  Elf64_Half e_phnum;
+  Elf64_Half e_shentsize;
+  Elf64_Half e_shnum;
+  Elf64_Half e_shstrndx;
+} Elf64_Ehdr;
+
+typedef struct {
+  Elf64_Word  p_type;
+  Elf64_Word  p_flags;
+  Elf64_Off   p_offset;
+  Elf64_Addr  p_vaddr;
+  Elf64_Addr  p_paddr;
+  Elf64_Xword p_filesz;
+  Elf64_Xword p_memsz;
+  Elf64_Xword p_align;
+} Elf64_Phdr;
+
+typedef struct {
+  Elf64_Word  st_name;
+  uint8_t     st_info;
+  uint8_t     st_other;
+  Elf64_Half  st_shndx;
+  Elf64_Addr  st_value;
+  Elf64_Xword st_size;
+} Elf64_Sym;
+
+typedef struct {
+  Elf64_Sxword d_tag;
+
+  union {
+    Elf64_Xword d_val;
+    Elf64_Addr  d_ptr;
+  } d_un;
+} Elf64_Dyn;
+
+typedef struct {
+  Elf64_Addr  r_offset;
+  Elf64_Xword r_info;
+} Elf64_Rel;
+
+typedef struct {
+  Elf64_Addr   r_offset;
+  Elf64_Xword  r_info;
+  Elf64_Sxword r_addend;
+} Elf64_Rela;
+
+#define ELF64_R_SYM( info )  ( ( info ) >> 32 )
+#define ELF64_R_TYPE( info ) ( ( uint32_t )( info ) )
+
+#define ELF_ST_BIND( info ) ( ( info ) >> 4 )
+#define ELF_ST_TYPE( info ) ( ( info ) & 0xf )
+
 /*
 
   ARM ELF
@@ -138,9 +218,144 @@ typedef struct {
 */
 
 #define R_ARM_ABS32     ( 2 )
+#define R_ARM_GLOB_DAT  ( 21 )
 #define R_ARM_JUMP_SLOT ( 22 )
 #define R_ARM_RELATIVE  ( 23 )
 
+/*
+
+  AArch64 ELF
+
+  5.7 Dynamic relocations "ELF for the Arm 64-bit Architecture (AArch64)"
+
+*/
+
+#define R_AARCH64_ABS64     ( 257 )
+#define R_AARCH64_GLOB_DAT  ( 1025 )
+#define R_AARCH64_JUMP_SLOT ( 1026 )
+#define R_AARCH64_RELATIVE  ( 1027 )
+
+/*
+
+  Target
+
+  The loader core is built for a single class/machine pair
+  ELF_TARGET_ARM (ELF32, REL) or ELF_TARGET_AARCH64 (ELF64, RELA), default follows the compiler
+  table strides are the native struct sizes, so every entry access is a constant offset
+
+*/
+
+#if !defined( ELF_TARGET_ARM ) && !defined( ELF_TARGET_AARCH64 )
+#if defined( __aarch64__ )
+#define ELF_TARGET_AARCH64
+#else
+#define ELF_TARGET_ARM
+#endif
+#endif
+
+#if defined( ELF_TARGET_AARCH64 )
+
+typedef Elf64_Half Elf_Half;
+typedef Elf64_Addr Elf_Addr;
+typedef Elf64_Xword Elf_Size;
+typedef Elf64_Ehdr Elf_Ehdr;
+typedef Elf64_Phdr Elf_Phdr;
+typedef Elf64_Sym Elf_Sym;
+typedef Elf64_Dyn Elf_Dyn;
+typedef Elf64_Rela Elf_Rel;
+
+#define ELF_CLASS   ELFCLASS64
+#define ELF_MACHINE EM_AARCH64
+#define ELF_THUNKS  ( 0 ) /* Profiling thunks are ARM code */
+
+#define DT_RELTAB      DT_RELA
+#define DT_RELTABSZ    DT_RELASZ
+#define DT_RELTABENT   DT_RELAENT
+#define DT_RELTABCOUNT DT_RELACOUNT
+
+#define ELF_R_SYM( info )  ELF64_R_SYM( info )
+#define ELF_R_TYPE( info ) ELF64_R_TYPE( info )
+
+#define R_JUMP_SLOT R_AARCH64_JUMP_SLOT
+
+#else
+
+typedef Elf32_Half Elf_Half;
+typedef Elf32_Addr Elf_Addr;
+typedef Elf32_Word Elf_Size;
+typedef Elf32_Ehdr Elf_Ehdr;
+typedef Elf32_Phdr Elf_Phdr;
+typedef Elf32_Sym Elf_Sym;
+typedef Elf32_Dyn Elf_Dyn;
+typedef Elf32_Rel Elf_Rel;
+
+#define ELF_CLASS   ELFCLASS32
+#define ELF_MACHINE EM_ARM
+#define ELF_THUNKS  ( 1 )
+
+#define DT_RELTAB      DT_REL
+#define DT_RELTABSZ    DT_RELSZ
+#define DT_RELTABENT   DT_RELENT
+#define DT_RELTABCOUNT DT_RELCOUNT
+
+#define ELF_R_SYM( info )  ELF32_R_SYM( info )
+#define ELF_R_TYPE( info ) ELF32_R_TYPE( info )
+
+#define R_JUMP_SLOT R_ARM_JUMP_SLOT
+
+#endif
+
+#define ELF_PH_GET( header, index )       ( ( Elf_Phdr * )( ( uintptr_t )( header ) + ( header )->e_phoff ) + ( index ) )
+#define ELF_PH_CONTENT( header, section ) ( ( uintptr_t )( header ) + ( section )->p_offset )
+
+/*
+
+  LZ4 frame
+
+  "LZ4 Frame Format Description" and "LZ4 Block Format Description"
+  checksums are skipped, dictionaries are not supported
+
+*/
+
+#define LZ4F_MAGIC ( 0x184D2204 )
+
+#define LZ4F_FLG_VERSION       ( 0xC0 )
+#define LZ4F_FLG_VERSION_01    ( 0x40 )
+#define LZ4F_FLG_BLOCK_CSUM    ( 0x10 )
+#define LZ4F_FLG_CONTENT_SIZE  ( 0x08 )
+#define LZ4F_FLG_CONTENT_CSUM  ( 0x04 )
+#define LZ4F_FLG_DICT_ID       ( 0x01 )
+
+#define LZ4F_BLOCK_UNCOMPRESSED ( 0x80000000 )
+
+#define LZ4_MIN_MATCH ( 4 )
+#define LZ4_MAX_OFFSET ( 65535 )
+
+/*
+
+  ARM instructions used by profiling thunks
+
+  ARMv4T compatible, every branch goes through "bx ip" so Thumb targets and hooks interwork
+  calls set lr with "mov lr, pc" first, loads into pc would not switch state before ARMv5T
+
+*/
+
+#define ARM_PUSH_R0_R3_IP_LR ( 0xE92D500F ) /* push {r0-r3, ip, lr} */
+#define ARM_POP_R0_R3_IP_LR  ( 0xE8BD500F ) /* pop {r0-r3, ip, lr} */
+#define ARM_PUSH_R0_R3       ( 0xE92D000F ) /* push {r0-r3} */
+#define ARM_POP_R0_R3        ( 0xE8BD000F ) /* pop {r0-r3} */
+#define ARM_SUB_R0_PC        ( 0xE24F0000 ) /* sub r0, pc, #imm8 */
+#define ARM_MOV_R1_LR        ( 0xE1A0100E ) /* mov r1, lr */
+#define ARM_MOV_LR_PC        ( 0xE1A0E00F ) /* mov lr, pc */
+#define ARM_MOV_IP_R0        ( 0xE1A0C000 ) /* mov ip, r0 */
+#define ARM_ADD_LR_PC        ( 0xE28FE000 ) /* add lr, pc, #imm8 */
+#define ARM_LDR_IP_R0        ( 0xE590C000 ) /* ldr ip, [r0, #imm12] */
+#define ARM_LDR_IP_PC        ( 0xE59FC000 ) /* ldr ip, [pc, #imm12] */
+#define ARM_LDREQ_IP_PC      ( 0x059FC000 ) /* ldreq ip, [pc, #imm12] */
+#define ARM_CMP_R0_0         ( 0xE3500000 ) /* cmp r0, #0 */
+#define ARM_BX_IP            ( 0xE12FFF1C ) /* bx ip */
+#define ARM_BXEQ_IP          ( 0x012FFF1C ) /* bxeq ip */
+
 /*
 
   Elf
@@ -149,6 +364,7 @@ typedef struct {
 
 #include "elf/elf.h"
 
+#include <stddef.h> /* offsetof */
 #include <stdlib.h> /* realloc */
 #include <string.h> /* memset memcpy */
 
@@ -164,6 +380,39 @@ typedef struct {
  */
 typedef void ( * elf_voidf )( void );
 
+/**
+ * Default number of table entries handed to each elf_taskf
+ * used when elf_parallel is given a grain of zero
+ */
+#define _ELF_DEFAULT_GRAIN ( 256 )
+
+/**
+ * Default module base alignment used by elf_pack
+ * matches what malloc guarantees for the single module elf_lbounds case
+ */
+#define _ELF_PACK_ALIGN ( 8 )
+
+/**
+ * Smallest ELF pool link buffer is ( 1 << _ELF_POOL_MIN_CLASS ) bytes
+ * each size class doubles the previous one
+ */
+#define _ELF_POOL_MIN_CLASS ( 6 )
+#define _ELF_POOL_CLASSES   ( sizeof( size_t ) * 8 )
+
+/**
+ * Profiling thunk call counts and timing claims
+ * atomic where the compiler has lock-free word atomics, plain accesses otherwise (profiling from one thread only)
+ */
+#if defined( __GCC_ATOMIC_INT_LOCK_FREE ) && ( __GCC_ATOMIC_INT_LOCK_FREE == 2 )
+#define _ELF_COUNT( X )   __atomic_fetch_add( ( X ), 1, __ATOMIC_RELAXED )
+#define _ELF_CLAIM( X )   __atomic_exchange_n( ( X ), 1, __ATOMIC_ACQUIRE )
+#define _ELF_RELEASE( X ) __atomic_store_n( ( X ), 0, __ATOMIC_RELEASE )
+#else
+#define _ELF_COUNT( X )   ( ( *( X ) )++ )
+#define _ELF_CLAIM( X )   ( *( X ) ? 1 : ( *( X ) = 1, 0 ) )
+#define _ELF_RELEASE( X ) ( *( X ) = 0 )
+#endif
+
 /**
  * Used for storing symbols in the link map
  * link map is stored in a lazy binary tree
@@ -175,6 +424,143 @@ typedef struct Elf_symbolNode {
   struct Elf_symbolNode * gt;
 } Elf_symbolNode;
 
+/**
+ * Pending dirty range waiting to be reported through elf_flushf
+ * adjacent ranges with matching flags are merged before reporting
+ */
+typedef struct {
+  uintptr_t addr;
+  size_t    size;
+  int       flags;
+} Elf_flushRange;
+
+/**
+ * Entry of the address index used by elf_dladdr
+ * sorted by addr, Thumb bit of function symbols is cleared
+ * reach is the highest symbol end of this and every earlier entry, it bounds the walk back
+ */
+typedef struct {
+  uintptr_t addr;
+  uintptr_t reach;
+  Elf_Size  index;
+} Elf_addrNode;
+
+struct Elf_thunk;
+
+/**
+ * C side of a profiling thunk, called on entry with the caller return address
+ * returns non-zero if the call is to be timed (return routed back through the thunk)
+ */
+typedef int ( * elf_enterf )( struct Elf_thunk *, uintptr_t );
+
+/**
+ * C side of a profiling thunk, called once a timed call returns
+ * returns the caller return address saved by elf_enterf
+ */
+typedef uintptr_t ( * elf_exitf )( struct Elf_thunk * );
+
+/**
+ * Profiling thunk placed in the extra area after the linked image
+ * one per jump slot relocation, the jump slot points at code while profiling is enabled
+ * code reads the fields below relative to itself, so the layout is fixed at link time
+ */
+typedef struct Elf_thunk {
+  uint32_t     code[22];
+  elf_enterf   enter;
+  elf_exitf    exit;
+  uintptr_t    target;
+  Elf_Addr *   slot;
+  const char * name;
+  void *       handle;
+  uintptr_t    ret;
+  uint32_t     active;
+  uint32_t     start;
+  uint32_t     calls;
+  uint64_t     cycles;
+} Elf_thunk;
+
+/**
+ * Relocation slot of an imported symbol, recorded for elf_rebind
+ * sorted by hash, symbol index and slot once linking finishes
+ */
+typedef struct {
+  int         hash;
+  Elf_Size    symbol;
+  Elf_Addr *  slot;
+  Elf_thunk * thunk;
+} Elf_rebindSlot;
+
+/**
+ * Resumable LZ4 frame decoder
+ * decoding can pause at any output byte and continue on a later call
+ */
+typedef struct {
+  const uint8_t * src;
+  const uint8_t * blockEnd;
+  uint8_t *       base;
+  uint8_t *       out;
+  size_t          literals;
+  size_t          match;
+  size_t          offset;
+  uint8_t         token;
+  uint8_t         sequence;
+  uint8_t         flg;
+  uint8_t         raw;
+  uint8_t         end;
+} Elf_lz4;
+
+/**
+ * Tables of an ELF_RTLD_LZ4 source kept decompressed from opening on
+ * only the header of the hash table (nbucket, nchain) is kept
+ */
+#define _ELF_KEEP_DYNAMIC   ( 0 )
+#define _ELF_KEEP_HASH      ( 1 )
+#define _ELF_KEEP_SYMTAB    ( 2 )
+#define _ELF_KEEP_STRTAB    ( 3 )
+#define _ELF_KEEP_RELTAB    ( 4 )
+#define _ELF_KEEP_JMPRELTAB ( 5 )
+#define _ELF_KEEP_COUNT     ( 6 )
+
+/**
+ * Decoded bytes handled at once while extracting the kept tables
+ * the window also holds the last LZ4_MAX_OFFSET bytes, which later matches may copy from
+ */
+#define _ELF_KEEP_CHUNK ( 16384 )
+
+/**
+ * Range of the source file kept decompressed
+ * data is allocated once the size is known and filled as decoding passes the range
+ */
+typedef struct {
+  Elf_Addr  vaddr;
+  size_t    offset;
+  size_t    size;
+  size_t    copied;
+  uint8_t * data;
+} Elf_keptTable;
+
+/**
+ * Progress of an elf_link_step link
+ * done and total count units of the current phase
+ */
+typedef struct {
+  int             phase;
+  void *          buf;
+  Elf_Half        segment;
+  size_t          offset;
+  size_t          fileEnd;
+  size_t          done;
+  size_t          total;
+  const Elf_Rel * reltab;
+  Elf_Size        relCount;
+  const Elf_Rel * jmpReltab;
+  Elf_Size        jmpCount;
+  elf_voidf *     initArray;
+  Elf_Size        initLength;
+  uint8_t *       imports;
+  Elf_lz4         lz4;
+} Elf_linkState;
+
 /**
  * Internal ELF context structure
  * instance is returned from elf_dl*open
@@ -184,17 +570,98 @@ typedef struct {
   void *           uptr;
   int              flags;
   const char *     error;
-  Elf32_Ehdr *     header;
+  Elf_Ehdr *       header;
+  const void *     source;
+  Elf_keptTable    kept[_ELF_KEEP_COUNT];
   Elf_symbolNode * globalSymbols;
   elf_voidf *      finiArray;
-  Elf32_Word       finiLength;
+  Elf_Size         finiLength;
+  elf_parallelf    parallel;
+  void *           parallelUptr;
+  Elf_Size         grain;
+  void *           linkBuf;
+  Elf_Sym *        symtab;
+  Elf_Size         symCount;
+  const char *     strtab;
+  Elf_addrNode *   addrIndex;
+  Elf_Size         addrLength;
+  elf_clockf       clock;
+  void *           clockUptr;
+  Elf_thunk *      thunks;
+  Elf_Size         thunkLength;
+  elf_flushf       flush;
+  void *           flushUptr;
+  Elf_rebindSlot * rebinds;
+  Elf_Size         rebindLength;
+  Elf_Size         rebindCapacity;
+  Elf_linkState    link;
 } Elf_handle;
 
+/**
+ * Shared state for one parallel link dispatch
+ * each task writes only its own errors slot
+ */
+typedef struct {
+  Elf_handle *    handle;
+  void *          buf;
+  Elf_Sym *       symtab;
+  Elf_Size        symCount;
+  const char *    strtab;
+  const Elf_Rel * reltab;
+  Elf_Size        relCount;
+  const Elf_Rel * jmpReltab;
+  Elf_Size        jmpCount;
+  Elf_Size        grain;
+  const char **   errors;
+} Elf_linkJob;
+
+/**
+ * Link buffer waiting in an ELF pool size class
+ * the free buffer itself holds the list link
+ */
+typedef struct Elf_poolBuffer {
+  struct Elf_poolBuffer * next;
+} Elf_poolBuffer;
+
+/**
+ * Module known to an ELF pool
+ * closed modules keep their handle and link buffer until evicted
+ */
+typedef struct {
+  const void *   source;
+  int            flag;
+  Elf_handle *   handle;
+  void *         buf;
+  int            sizeClass;
+  int            open;
+  size_t         stamp;
+} Elf_poolEntry;
+
+/**
+ * Internal ELF pool structure
+ * instance is returned from elf_poolcreate
+ */
+typedef struct {
+  elf_allocf       alloc;
+  void *           uptr;
+  Elf_poolEntry *  entries;
+  size_t           entryLength;
+  size_t           entryCapacity;
+  size_t           cached;
+  size_t           clock;
+  Elf_poolBuffer * buffers[_ELF_POOL_CLASSES];
+} Elf_pool;
+
 /**
  * Handy macro for casting pointer to usable Elf_handle
  */
 #define _ELF_H( X ) ( ( Elf_handle * )( X ) )
 
+/**
+ * Handy macro for casting pointer to usable Elf_pool
+ */
+#define _ELF_POOL( X ) ( ( Elf_pool * )( X ) )
+
 /**
  * Error string messages
  * these are not descriptive to save space and be displayable on short column
@@ -212,6 +679,11 @@ static const char * const _elf_error_unresolved_symbol        = "Unresolved symb
 static const char * const _elf_error_unimplemented_st_shndx   = "Unimplemented st_shndx";
 static const char * const _elf_error_zero_sized_rel           = "Zero sized rel";
 static const char * const _elf_error_unimplemented_relocation = "Unimplemented relocation";
+static const char * const _elf_error_machine                  = "Machine";
+static const char * const _elf_error_entry_size               = "Entry size";
+static const char * const _elf_error_lz4                      = "LZ4";
+static const char * const _elf_error_layout                   = "Layout";
+static const char * const _elf_error_allocation               = "Allocation";
 
 /**
  * Handy short cut for calling custom elf_allocf as malloc
@@ -279,7 +751,7 @@ static void _elf_check( Elf_handle * handle ) {
     return;
   }
 
-  if ( handle->header->e_ident[EI_CLASS] != ELFCLASS32 ) {
+  if ( handle->header->e_ident[EI_CLASS] != ELF_CLASS ) {
     handle->flags |= _ELF_ERROR;
     handle->error = _elf_error_class;
     return;
@@ -302,6 +774,19 @@ static void _elf_check( Elf_handle * handle ) {
     handle->error = _elf_error_type;
     return;
   }
+
+  if ( handle->header->e_machine != ELF_MACHINE ) {
+    handle->flags |= _ELF_ERROR;
+    handle->error = _elf_error_machine;
+    return;
+  }
+
+  /* Program headers are walked with a fixed stride */
+  if ( handle->header->e_phentsize != sizeof( Elf_Phdr ) ) {
+    handle->flags |= _ELF_ERROR;
+    handle->error = _elf_error_entry_size;
+    return;
+  }
 }
 
 /**
@@ -386,164 +871,357 @@ static void _elf_tree_add( Elf_handle * handle, const int hash, void * sym ) {
 }
 
 /**
- * Relocates symbols within a given relocation table
- * @param handle  ELF context structure
- * @param buf     Executable memory ELF is linking into
- * @param reltab  Source relocation table
- * @param entsize Span between each relocation in table
- * @param limit   Size of the relocation table
- * @param symtab  Symbol table to be resolved
- * @param syment  Span between each symbol entry
+ * Relocates a range of entries within a given relocation table
+ * touches nothing but the image, so disjoint ranges may run concurrently
+ * the switch only holds the relocation types of the target machine
+ * @param  buf    Executable memory ELF is linking into
+ * @param  reltab Source relocation table
+ * @param  begin  Index of first relocation to apply
+ * @param  end    Index one past the last relocation to apply
+ * @param  symtab Symbol table to be resolved
+ * @return        Error Cstring or NULL on success
  */
-static void _elf_relocate( Elf_handle * handle, void * buf, uintptr_t reltab, Elf32_Word entsize, Elf32_Word limit, uintptr_t symtab, Elf32_Word syment ) {
-  const uintptr_t tableEnd = reltab + limit;
-
+static const char * _elf_relocate_range( void * buf, const Elf_Rel * reltab, Elf_Size begin, Elf_Size end, const Elf_Sym * symtab ) {
   /* Loop through relocation table and relocate the symbols */
-  while ( reltab < tableEnd ) {
-    const Elf32_Rel * const rel = ( Elf32_Rel * )reltab;
-    const Elf32_Sym * const symbol = ( Elf32_Sym * )( symtab + ( ELF32_R_SYM( rel->r_info ) * syment ) );
-    uint32_t * const ref = ( uint32_t * )( ( uintptr_t )buf + rel->r_offset );
-
-    switch ( ELF32_R_TYPE( rel->r_info ) ) {
+  for ( Elf_Size ii = begin; ii < end; ii++ ) {
+    const Elf_Rel * const rel = &reltab[ii];
+    const Elf_Sym * const symbol = &symtab[ELF_R_SYM( rel->r_info )];
+    Elf_Addr * const ref = ( Elf_Addr * )( ( uintptr_t )buf + rel->r_offset );
+
+    switch ( ELF_R_TYPE( rel->r_info ) ) {
+#if defined( ELF_TARGET_AARCH64 )
+    case R_AARCH64_ABS64:
+    case R_AARCH64_GLOB_DAT:
+    case R_AARCH64_JUMP_SLOT:
+      *ref = symbol->st_value + rel->r_addend;
+      break;
+    case R_AARCH64_RELATIVE:
+      *ref = ( uintptr_t )buf + rel->r_addend;
+      break;
+#else
     case R_ARM_ABS32:
       *ref += symbol->st_value;
       break;
+    case R_ARM_GLOB_DAT:
     case R_ARM_JUMP_SLOT:
       *ref = symbol->st_value;
       break;
     case R_ARM_RELATIVE:
       *ref += ( uintptr_t )buf;
       break;
+#endif
     default:
-      handle->flags |= _ELF_ERROR;
-      handle->error = _elf_error_unimplemented_relocation;
-      return;
+      return _elf_error_unimplemented_relocation;
     }
-
-    reltab += entsize;
   }
+
+  return NULL;
 }
 
-/*
+/**
+ * Resolves a range of symbols within the dynamic symbol table
+ * the link map is only read, so disjoint ranges may run concurrently
+ * @param  handle ELF context structure
+ * @param  buf    Executable memory ELF is linking into
+ * @param  symtab Symbol table to be resolved
+ * @param  strtab String table holding symbol names
+ * @param  begin  Index of first symbol to resolve
+ * @param  end    Index one past the last symbol to resolve
+ * @return        Error Cstring or NULL on success
+ */
+static const char * _elf_resolve_range( Elf_handle * handle, void * buf, Elf_Sym * symtab, const char * strtab, Elf_Size begin, Elf_Size end ) {
+  for ( Elf_Size ii = begin; ii < end; ii++ ) {
+    Elf_Sym * const symbol = &symtab[ii];
 
-  ELF implementations
+    if ( symbol->st_shndx == SHN_UNDEF ) {
+      void * const resolved = _elf_tree_find( handle, _elf_hash( strtab + symbol->st_name ) );
 
-*/
+      if ( !resolved && !( ELF_ST_BIND( symbol->st_info ) & STB_WEAK ) ) {
+        return _elf_error_unresolved_symbol;
+      }
+
+      symbol->st_shndx = SHN_ABS;
+      symbol->st_value = ( Elf_Addr )resolved;
+    } else if (symbol->st_shndx < SHN_LORESERVE) {
+      symbol->st_shndx = SHN_ABS;
+      symbol->st_value = ( Elf_Addr )( symbol->st_value + ( uintptr_t )buf );
+    } else if ( symbol->st_shndx != SHN_ABS ) {
+      return _elf_error_unimplemented_st_shndx;
+    }
+  }
+
+  return NULL;
+}
 
 /**
- * ELF initialization (default realloc/free)
- * @param  buf  Pointer to ELF file in memory
- * @param  flag ELF_RTLD_* bit flags (defined above)
- * @return      Handle to loaded ELF context
+ * Number of grain sized chunks needed to cover a table
+ * @param  count Number of table entries
+ * @param  grain Entries per chunk
+ * @return       Chunk count
  */
-void * elf_dlmemopen( const void * buf, int flag ) {
-  Elf_handle * const handle = ( Elf_handle * )_elf_stdalloc( NULL, NULL, sizeof( *handle ) );
+inline static Elf_Size _elf_chunks( Elf_Size count, Elf_Size grain ) {
+  return ( count + grain - 1 ) / grain;
+}
 
-  handle->alloc = _elf_stdalloc;
-  handle->uptr = NULL;
-  handle->flags = flag;
-  handle->header = ( Elf32_Ehdr * )buf;
-  handle->globalSymbols = NULL;
-  handle->finiArray = NULL;
-  handle->finiLength = 0;
+/**
+ * elf_taskf resolving one chunk of the dynamic symbol table
+ * symbol zero is reserved, so chunks start counting from index one
+ * @param ctx   Elf_linkJob shared by the dispatch
+ * @param index Chunk index
+ */
+static void _elf_resolve_task( void * ctx, size_t index ) {
+  Elf_linkJob * const job = ( Elf_linkJob * )ctx;
+  const Elf_Size begin = 1 + ( Elf_Size )index * job->grain;
+  Elf_Size end = begin + job->grain;
 
-  if ( ( handle->flags & ELF_RTLD_SKIP_CHECK ) == 0 ) {
-    _elf_check( handle );
+  if ( end > job->symCount ) {
+    end = job->symCount;
   }
 
-  return handle;
+  job->errors[index] = _elf_resolve_range( job->handle, job->buf, job->symtab, job->strtab, begin, end );
 }
 
 /**
- * ELF initialization (custom allocator, see elf_allocf)
- * @param  buf   Pointer to ELF file in memory
- * @param  flag  ELF_RTLD_* bit flags (defined above)
- * @param  alloc Realloc with a uptr cookie
- * @param  uptr  Cookie user pointer to be sent to elf_allocf
- * @return       Handle to loaded ELF context
+ * elf_taskf relocating one chunk of DT_REL followed by DT_JMPREL
+ * chunk indices past the end of DT_REL continue into DT_JMPREL
+ * @param ctx   Elf_linkJob shared by the dispatch
+ * @param index Chunk index
  */
-void * elf_dlmemopen_alloc( const void * buf, int flag, elf_allocf alloc, void * uptr ) {
-  Elf_handle * const handle = ( Elf_handle * )alloc( uptr, NULL, sizeof( *handle ) );
+static void _elf_relocate_task( void * ctx, size_t index ) {
+  Elf_linkJob * const job = ( Elf_linkJob * )ctx;
+  const Elf_Size relChunks = _elf_chunks( job->relCount, job->grain );
+  const Elf_Rel * reltab = job->reltab;
+  Elf_Size count = job->relCount;
+  Elf_Size chunk = ( Elf_Size )index;
+
+  if ( chunk >= relChunks ) {
+    reltab = job->jmpReltab;
+    count = job->jmpCount;
+    chunk -= relChunks;
+  }
 
-  handle->alloc = alloc;
-  handle->uptr = uptr;
-  handle->flags = flag;
-  handle->header = ( Elf32_Ehdr * )buf;
-  handle->globalSymbols = NULL;
-  handle->finiArray = NULL;
-  handle->finiLength = 0;
+  const Elf_Size begin = chunk * job->grain;
+  Elf_Size end = begin + job->grain;
 
-  if ( ( handle->flags & ELF_RTLD_SKIP_CHECK ) == 0 ) {
-    _elf_check( handle );
+  if ( end > count ) {
+    end = count;
   }
 
-  return handle;
+  job->errors[index] = _elf_relocate_range( job->buf, reltab, begin, end, job->symtab );
 }
 
 /**
- * Unlinks and destroys ELF context
- * @param handle Valid, open ELF context
+ * Hands chunks to the user parallel-for and gathers their errors
+ * the first failing chunk (in table order) becomes the handle error
+ * @param  job   Elf_linkJob shared by the dispatch
+ * @param  task  Chunk worker
+ * @param  count Number of chunks
+ * @return       Non-zero if any chunk failed
  */
-void elf_dlclose( void * handle ) {
-  /* Call ELF destructors */
-  for ( Elf32_Word ii = 0; ii < _ELF_H( handle )->finiLength; ii++ ) {
-    ( *_ELF_H( handle )->finiArray[ii] )();
+static int _elf_dispatch( Elf_linkJob * job, elf_taskf task, Elf_Size count ) {
+  if ( !count ) {
+    return 0;
   }
 
-  /* Release link map */
-  if ( _ELF_H( handle )->globalSymbols ) {
-    _elf_tree_free( _ELF_H( handle ), _ELF_H( handle )->globalSymbols );
+  for ( Elf_Size ii = 0; ii < count; ii++ ) {
+    job->errors[ii] = NULL;
   }
 
-  const elf_allocf alloc = _ELF_H( handle )->alloc;
-  void * const uptr = _ELF_H( handle )->uptr;
+  job->handle->parallel( job->handle->parallelUptr, task, job, count );
 
-  alloc( uptr, handle, 0 );
+  for ( Elf_Size ii = 0; ii < count; ii++ ) {
+    if ( job->errors[ii] ) {
+      job->handle->flags |= _ELF_ERROR;
+      job->handle->error = job->errors[ii];
+      return 1;
+    }
+  }
+
+  return 0;
 }
 
 /**
- * Get ELF error message
- * also clears the internal error state of the ELF context
- * @param  handle Valid, open ELF context
- * @return        Error message as a Cstring, invalidated by subsequent elf_ calls
+ * Symbol resolution and relocation split across the user parallel-for
+ * resolution and relocation are separate dispatches as relocations read resolved symbols
+ * exports are mapped before the imports resolve, so an import may bind to an export of the same module
+ * @param  job Elf_linkJob describing the tables, errors must be NULL
+ * @return     Non-zero if the job could not be dispatched (serial fallback required)
  */
-const char * elf_dlerror( void * handle ) {
-  if ( _ELF_H( handle )->flags & _ELF_ERROR ) {
-    _ELF_H( handle )->flags &= ~_ELF_ERROR; /* Remove error flag */
-    return _ELF_H( handle )->error;
+static int _elf_link_parallel( Elf_linkJob * job ) {
+  Elf_handle * const handle = job->handle;
+
+  /* Symbol zero is reserved, nothing to resolve */
+  if ( job->symCount < 2 ) {
+    return 1;
   }
 
-  return NULL;
+  const Elf_Size symChunks = _elf_chunks( job->symCount - 1, job->grain );
+  const Elf_Size relChunks = _elf_chunks( job->relCount, job->grain ) + _elf_chunks( job->jmpCount, job->grain );
+  const Elf_Size maxChunks = ( symChunks > relChunks ? symChunks : relChunks );
+
+  job->errors = ( const char ** )_elf_malloc( handle, sizeof( *job->errors ) * maxChunks );
+  if ( !job->errors ) {
+    return 1;
+  }
+
+  /* Exported symbols enter the link map serially, the tree is not thread safe */
+  for ( Elf_Size ii = 1; ii < job->symCount; ii++ ) {
+    const Elf_Sym * const symbol = &job->symtab[ii];
+
+    if ( !( ELF_ST_BIND( symbol->st_info ) & STB_GLOBAL ) || symbol->st_shndx == SHN_UNDEF ) {
+      continue;
+    }
+
+    if ( symbol->st_shndx < SHN_LORESERVE ) {
+      elf_mapsym( handle, job->strtab + symbol->st_name, ( void * )( symbol->st_value + ( uintptr_t )job->buf ) );
+    } else if ( symbol->st_shndx == SHN_ABS ) {
+      elf_mapsym( handle, job->strtab + symbol->st_name, ( void * )symbol->st_value );
+    }
+  }
+
+  if ( !_elf_dispatch( job, _elf_resolve_task, symChunks ) ) {
+    _elf_dispatch( job, _elf_relocate_task, relChunks );
+  }
+
+  _elf_free( handle, job->errors );
+  return 0;
 }
 
 /**
- * Add symbol to ELF link map
- * required symbols referenced in the ELF should use this
- * @param handle Valid, open ELF context
- * @param name   Symbol name that will be used by linker
- * @param sym    Pointer to symbol data that will be used by linker
+ * Reports the pending dirty range, if any, and clears it
+ * @param handle ELF context structure
+ * @param range  Pending range
  */
-void elf_mapsym( void * handle, const char * name, void * sym ) {
-  const int hash = _elf_hash( name );
-
-  _elf_tree_add( _ELF_H( handle ), hash, sym );
+static void _elf_flush_end( Elf_handle * handle, Elf_flushRange * range ) {
+  if ( range->size ) {
+    handle->flush( handle->flushUptr, ( void * )range->addr, range->size, range->flags );
+    range->size = 0;
+  }
 }
 
 /**
- * Return memory requirements of linked ELF
- * returned size should be used to allocate space to link ELF into
- * @param  handle Valid, open ELF context
- * @return        Memory byte requirement length
+ * Adds a dirty range, merging it with the pending one when they touch
+ * does nothing without an elf_flushf
+ * @param handle ELF context structure
+ * @param range  Pending range
+ * @param addr   Start of modified memory
+ * @param size   Byte length of modified memory
+ * @param flags  ELF_FLUSH_* tag of the memory
  */
-size_t elf_lbounds( void * handle ) {
+static void _elf_flush_add( Elf_handle * handle, Elf_flushRange * range, uintptr_t addr, size_t size, int flags ) {
+  if ( !handle->flush || !size ) {
+    return;
+  }
+
+  if ( range->size && range->flags == flags && range->addr + range->size == addr ) {
+    range->size += size;
+    return;
+  }
+
+  _elf_flush_end( handle, range );
+  range->addr = addr;
+  range->size = size;
+  range->flags = flags;
+}
+
+/**
+ * Locate the PT_DYNAMIC program header
+ * @param  header ELF file header
+ * @return        Dynamic program header or NULL if missing
+ */
+static const Elf_Phdr * _elf_dynamic( const Elf_Ehdr * header ) {
+  for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+    Elf_Phdr * const section = ELF_PH_GET( header, ii );
+
+    if ( section->p_type == PT_DYNAMIC ) {
+      return section;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Locates a virtual address of the ELF within the source file
+ * @param  header ELF file header, at the start of the source file
+ * @param  vaddr  Virtual address to locate
+ * @return        Pointer into the source file, or NULL if vaddr is not file backed
+ */
+static const void * _elf_source_addr( const Elf_Ehdr * header, Elf_Addr vaddr ) {
+  for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+    Elf_Phdr * const h = ELF_PH_GET( header, ii );
+
+    if ( h->p_type == PT_LOAD && vaddr >= h->p_vaddr && vaddr - h->p_vaddr < h->p_filesz ) {
+      return ( const void * )( ELF_PH_CONTENT( header, h ) + ( vaddr - h->p_vaddr ) );
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Kept copy of a table of an ELF_RTLD_LZ4 source
+ * @param  handle ELF context structure
+ * @param  index  _ELF_KEEP_* table
+ * @return        Table bytes, or NULL if unavailable
+ */
+static const void * _elf_kept( Elf_handle * handle, int index ) {
+  const Elf_keptTable * const table = &handle->kept[index];
+
+  return ( table->data && table->copied == table->size ? table->data : NULL );
+}
+
+/**
+ * Locates a virtual address of the ELF within the source, or within the kept tables of an ELF_RTLD_LZ4 source
+ * @param  handle ELF context structure
+ * @param  vaddr  Virtual address to locate
+ * @return        Pointer to the source bytes, or NULL if unavailable
+ */
+static const void * _elf_source_table( Elf_handle * handle, Elf_Addr vaddr ) {
+  if ( !( handle->flags & ELF_RTLD_LZ4 ) ) {
+    return _elf_source_addr( handle->header, vaddr );
+  }
+
+  for ( int ii = 0; ii < _ELF_KEEP_COUNT; ii++ ) {
+    const Elf_keptTable * const table = &handle->kept[ii];
+
+    if ( _elf_kept( handle, ii ) && vaddr >= table->vaddr && vaddr - table->vaddr < table->size ) {
+      return table->data + ( vaddr - table->vaddr );
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Dynamic section of the source, kept decompressed for ELF_RTLD_LZ4 sources
+ * @param  handle ELF context structure
+ * @return        Dynamic entries, or NULL if unavailable
+ */
+static const Elf_Dyn * _elf_source_dynamic( Elf_handle * handle ) {
+  if ( handle->flags & ELF_RTLD_LZ4 ) {
+    return ( const Elf_Dyn * )_elf_kept( handle, _ELF_KEEP_DYNAMIC );
+  }
+
+  const Elf_Phdr * const dynamicSection = _elf_dynamic( handle->header );
+
+  return ( dynamicSection ? ( const Elf_Dyn * )ELF_PH_CONTENT( handle->header, dynamicSection ) : NULL );
+}
+
+/**
+ * Memory requirement of the loadable segments alone
+ * @param  handle ELF context structure
+ * @return        Byte length of the linked image
+ */
+static size_t _elf_image_bounds( Elf_handle * handle ) {
   size_t high = 0;
 
   /* Size needed is the size of the program binary in ELF */
-  for ( Elf32_Half ii = 0; ii < _ELF_H( handle )->header->e_phnum; ii++ ) {
-    Elf32_Phdr * const program = ELF32_PH_GET( _ELF_H( handle )->header, ii );
+  for ( Elf_Half ii = 0; ii < handle->header->e_phnum; ii++ ) {
+    Elf_Phdr * const program = ELF_PH_GET( handle->header, ii );
 
     if ( program->p_type == PT_LOAD ) {
-      uint32_t segMax = program->p_vaddr + program->p_memsz;
+      Elf_Addr segMax = program->p_vaddr + program->p_memsz;
 
       segMax = ( ( segMax - 1 ) / program->p_align + 1 ) * program->p_align;
 
@@ -557,189 +1235,2365 @@ size_t elf_lbounds( void * handle ) {
 }
 
 /**
- * Link ELF into given memory buffer
- * all resolution is done in this step
- * missing symbols must be already added by elf_mapsym
- * @param handle Valid, open ELF context
- * @param buf    Allocated memory of size given by elf_lbounds
+ * Exact address range of the loadable segments, without alignment padding
+ * @param handle ELF context structure
+ * @param low    Receives the lowest p_vaddr
+ * @param high   Receives the highest p_vaddr + p_memsz
  */
-void elf_link( void * handle, void * buf ) {
-  const Elf32_Ehdr * const header = _ELF_H( handle )->header;
-  const Elf32_Phdr * dynamicSection = NULL;
+static void _elf_image_extent( Elf_handle * handle, size_t * low, size_t * high ) {
+  *low = ~( size_t )0;
+  *high = 0;
 
-  /* Copy ELF program into memory and prepares static variables */
-  for ( Elf32_Half ii = 0; ii < header->e_phnum; ii++ ) {
-    Elf32_Phdr * const h = ELF32_PH_GET( header, ii );
+  for ( Elf_Half ii = 0; ii < handle->header->e_phnum; ii++ ) {
+    Elf_Phdr * const program = ELF_PH_GET( handle->header, ii );
 
-    if ( h->p_type == PT_LOAD ) {
-      const uintptr_t dest = ( uintptr_t )buf + h->p_vaddr;
+    if ( program->p_type == PT_LOAD ) {
+      if ( program->p_vaddr < *low ) {
+        *low = program->p_vaddr;
+      }
 
-      memset( ( void * )( dest + h->p_filesz ), 0, h->p_memsz - h->p_filesz );
-      memcpy( ( void * )dest, ( void * )ELF32_PH_CONTENT( header, h ), h->p_filesz );
+      if ( program->p_vaddr + program->p_memsz > *high ) {
+        *high = program->p_vaddr + program->p_memsz;
+      }
     }
   }
 
-  /* Find dynamic section */
-  for ( Elf32_Half ii = 0; ii < header->e_phnum; ii++ ) {
-    Elf32_Phdr * const section = ELF32_PH_GET( header, ii );
+  if ( *low > *high ) {
+    *low = *high;
+  }
+}
 
-    if ( section->p_type == PT_DYNAMIC ) {
-      dynamicSection = section;
-      break;
+/**
+ * Offset of the profiling thunk area within the link memory
+ * @param  handle ELF context structure
+ * @return        Byte offset, aligned for Elf_thunk
+ */
+static size_t _elf_thunk_offset( Elf_handle * handle ) {
+  size_t low, high;
+
+  _elf_image_extent( handle, &low, &high );
+  return ( high + 7 ) & ~( size_t )7;
+}
+
+/**
+ * Number of profiling thunks the ELF needs (one per DT_JMPREL entry)
+ * @param  handle ELF context structure
+ * @return        Thunk count
+ */
+static Elf_Size _elf_thunk_count( Elf_handle * handle ) {
+  const Elf_Dyn * const dynamicEntries = _elf_source_dynamic( handle );
+
+  if ( !ELF_THUNKS || !dynamicEntries ) {
+    return 0;
+  }
+
+  for ( const Elf_Dyn * dynamics = dynamicEntries; dynamics->d_tag != DT_NULL; dynamics++ ) {
+    if ( dynamics->d_tag == DT_PLTRELSZ ) {
+      return dynamics->d_un.d_val / sizeof( Elf_Rel );
     }
   }
 
-  /* Dynamic section is kind of important for dynamic libraries */
-  if ( !dynamicSection ) {
-    _ELF_H( handle )->flags |= _ELF_ERROR;
-    _ELF_H( handle )->error = _elf_error_dynamic_section;
-    return;
+  return 0;
+}
+
+/**
+ * Profiling thunk entry, counts the call and decides whether to time it
+ * nested, concurrent or unclocked calls are only counted and jump straight to the target
+ * the call that claims active owns ret and start until its exit
+ * @param  thunk Thunk being called through
+ * @param  ret   Caller return address
+ * @return       Non-zero if the call is timed
+ */
+static int _elf_thunk_enter( Elf_thunk * thunk, uintptr_t ret ) {
+  Elf_handle * const handle = _ELF_H( thunk->handle );
+
+  _ELF_COUNT( &thunk->calls );
+
+  if ( !handle->clock || _ELF_CLAIM( &thunk->active ) ) {
+    return 0;
   }
 
-  Elf32_Word pltrelsz = 0, strsz = 0, syment = 0, relsz = 0, relent = 0, initLength = 0;
-  uintptr_t reltab = 0, jmpReltab = 0, symtab = 0;
-  const Elf32_Word * hash = NULL;
-  const char * strtab = NULL;
-  const elf_voidf * initArray = NULL;
+  thunk->ret = ret;
+  thunk->start = handle->clock( handle->clockUptr );
+  return 1;
+}
 
-  /* Pull out the table information from the dynamic section */
-  /* this will be used for dynamic relocation */
-  for ( Elf32_Dyn * dynamics = ( Elf32_Dyn * )ELF32_PH_CONTENT( header, dynamicSection ); dynamics->d_tag != DT_NULL; dynamics++) {
-    switch ( dynamics->d_tag ) {
-    case DT_NEEDED: /* Dependencies are not supported, so return */
-      _ELF_H( handle )->flags |= _ELF_ERROR;
-      _ELF_H( handle )->error = _elf_error_dependency;
-      return;
-    case DT_PLTRELSZ:
-      pltrelsz = dynamics->d_un.d_val;
-      break;
-    case DT_HASH:
-      hash = ( Elf32_Word * )( ( uintptr_t )header + dynamics->d_un.d_ptr );
-      break;
-    case DT_STRTAB:
-      strtab = ( const char * )( ( uintptr_t )header + dynamics->d_un.d_ptr );
-      break;
-    case DT_SYMTAB:
-      symtab = ( uintptr_t )buf + dynamics->d_un.d_ptr;
-      break;
-    case DT_STRSZ:
-      strsz = dynamics->d_un.d_val;
-      break;
-    case DT_SYMENT:
-      syment = dynamics->d_un.d_val;
-      break;
-    case DT_REL:
-      reltab = ( uintptr_t )header + dynamics->d_un.d_ptr;
-      break;
-    case DT_RELSZ:
-      relsz = dynamics->d_un.d_val;
-      break;
-    case DT_RELENT:
-      relent = dynamics->d_un.d_val;
-      break;
-    case DT_JMPREL:
-      jmpReltab = ( uintptr_t )header + dynamics->d_un.d_ptr;
-      break;
-    case DT_INIT_ARRAY:
-      initArray = ( elf_voidf * )( dynamics->d_un.d_ptr + ( uintptr_t )buf );
-      break;
-    case DT_INIT_ARRAYSZ:
-      initLength = dynamics->d_un.d_val / sizeof( Elf32_Addr );
-      break;
-    case DT_FINI_ARRAY:
-      _ELF_H( handle )->finiArray = ( elf_voidf * )( dynamics->d_un.d_ptr + ( uintptr_t )buf );
-      break;
-    case DT_FINI_ARRAYSZ:
-      _ELF_H( handle )->finiLength = dynamics->d_un.d_val / sizeof( Elf32_Addr );
-      break;
-    case DT_PLTGOT: /* Ignore these sections */
-    case DT_INIT:
-    case DT_FINI:
-    case DT_PLTREL:
-    case DT_TEXTREL:
-    case 0x6FFFFFFA:
-      break;
-    default:
-      _ELF_H( handle )->flags |= _ELF_ERROR;
-      _ELF_H( handle )->error = _elf_error_d_tag;
-      return;
+/**
+ * Profiling thunk exit, accumulates the cycles of a timed call
+ * @param  thunk Thunk being returned through
+ * @return       Caller return address saved by _elf_thunk_enter
+ */
+static uintptr_t _elf_thunk_exit( Elf_thunk * thunk ) {
+  Elf_handle * const handle = _ELF_H( thunk->handle );
+  const uintptr_t ret = thunk->ret;
+
+  thunk->cycles += ( uint32_t )( handle->clock( handle->clockUptr ) - thunk->start );
+  _ELF_RELEASE( &thunk->active );
+  return ret;
+}
+
+/**
+ * Writes the code and bookkeeping of a profiling thunk
+ * the code saves the argument registers around the C hooks so the target sees the original call
+ * @param handle ELF context structure
+ * @param thunk  Thunk to fill
+ * @param slot   Jump slot routed through the thunk
+ * @param name   Imported symbol name
+ */
+static void _elf_thunk_init( Elf_handle * handle, Elf_thunk * thunk, Elf_Addr * slot, const char * name ) {
+  const uint32_t target = offsetof( Elf_thunk, target );
+  uint32_t * const code = thunk->code;
+
+  code[0] = ARM_PUSH_R0_R3_IP_LR;
+  code[1] = ARM_SUB_R0_PC | 12;                                  /* r0 = thunk */
+  code[2] = ARM_MOV_R1_LR;
+  code[3] = ARM_LDR_IP_R0 | offsetof( Elf_thunk, enter );
+  code[4] = ARM_MOV_LR_PC;
+  code[5] = ARM_BX_IP;
+  code[6] = ARM_CMP_R0_0;
+  code[7] = ARM_POP_R0_R3_IP_LR;
+  code[8] = ARM_LDREQ_IP_PC | ( target - 40 );                   /* untimed, tail call */
+  code[9] = ARM_BXEQ_IP;
+  code[10] = ARM_ADD_LR_PC | 4;                                  /* return to code[13] */
+  code[11] = ARM_LDR_IP_PC | ( target - 52 );
+  code[12] = ARM_BX_IP;
+  code[13] = ARM_PUSH_R0_R3;
+  code[14] = ARM_SUB_R0_PC | 64;                                 /* r0 = thunk */
+  code[15] = ARM_LDR_IP_R0 | offsetof( Elf_thunk, exit );
+  code[16] = ARM_MOV_LR_PC;
+  code[17] = ARM_BX_IP;
+  code[18] = ARM_MOV_IP_R0;
+  code[19] = ARM_POP_R0_R3;
+  code[20] = ARM_BX_IP;
+  code[21] = 0;
+
+  thunk->enter = _elf_thunk_enter;
+  thunk->exit = _elf_thunk_exit;
+  thunk->target = *slot;
+  thunk->slot = slot;
+  thunk->name = name;
+  thunk->handle = handle;
+  thunk->ret = 0;
+  thunk->active = 0;
+  thunk->start = 0;
+  thunk->calls = 0;
+  thunk->cycles = 0;
+}
+
+/**
+ * Builds profiling thunks for every jump slot and routes the slots through them
+ * must run after relocation so the slots hold their resolved targets
+ * @param handle    ELF context structure
+ * @param buf       Executable memory ELF is linking into
+ * @param jmpReltab DT_JMPREL table
+ * @param pltrelsz  Size of the DT_JMPREL table
+ */
+static void _elf_thunk_link( Elf_handle * handle, void * buf, const Elf_Rel * jmpReltab, Elf_Size pltrelsz ) {
+  Elf_thunk * const thunks = ( Elf_thunk * )( ( uintptr_t )buf + _elf_thunk_offset( handle ) );
+  const Elf_Size count = pltrelsz / sizeof( Elf_Rel );
+  const Elf_Size capacity = _elf_thunk_count( handle ); /* Room made by elf_lbounds */
+  Elf_Size length = 0;
+
+  for ( Elf_Size ii = 0; ii < count && length < capacity; ii++ ) {
+    const Elf_Rel * const rel = &jmpReltab[ii];
+    const Elf_Sym * const symbol = &handle->symtab[ELF_R_SYM( rel->r_info )];
+
+    if ( ELF_R_TYPE( rel->r_info ) == R_JUMP_SLOT ) {
+      Elf_Addr * const slot = ( Elf_Addr * )( ( uintptr_t )buf + rel->r_offset );
+
+      _elf_thunk_init( handle, &thunks[length], slot, handle->strtab + symbol->st_name );
+      *slot = ( Elf_Addr )( uintptr_t )thunks[length].code;
+      length++;
     }
   }
 
-  if ( !hash || !strtab || !symtab || !syment || !strsz ) {
-    _ELF_H( handle )->flags |= _ELF_ERROR;
-    _ELF_H( handle )->error = _elf_error_missing_entries;
+  handle->thunks = thunks;
+  handle->thunkLength = length;
+}
+
+/**
+ * qsort comparator ordering Elf_addrNode by address
+ * @param  a First Elf_addrNode
+ * @param  b Second Elf_addrNode
+ * @return   Negative, zero or positive like strcmp
+ */
+static int _elf_addr_compare( const void * a, const void * b ) {
+  const uintptr_t lhs = ( ( const Elf_addrNode * )a )->addr;
+  const uintptr_t rhs = ( ( const Elf_addrNode * )b )->addr;
+
+  return ( lhs > rhs ) - ( lhs < rhs );
+}
+
+/**
+ * Builds the address index used by elf_dladdr
+ * only function and object symbols defined inside the loaded segments are indexed
+ * packed modules share a region, so the range stops at the segments of this module
+ * @param handle ELF context structure, must be linked
+ */
+static void _elf_addr_build( Elf_handle * handle ) {
+  size_t lowest, highest;
+  Elf_Size length = 0;
+
+  _elf_image_extent( handle, &lowest, &highest );
+
+  const uintptr_t low = ( uintptr_t )handle->linkBuf + lowest;
+  const uintptr_t high = ( uintptr_t )handle->linkBuf + highest;
+
+  handle->addrIndex = ( Elf_addrNode * )_elf_malloc( handle, sizeof( *handle->addrIndex ) * handle->symCount );
+  if ( !handle->addrIndex ) {
     return;
   }
 
-  /* Actual symbol resolution */
-  /* any global symbols added by elf_mapsym are resolved here */
-  for ( Elf32_Word ii = 1; ii < hash[1]; ii++ ) {
-    Elf32_Sym * const symbol = ( Elf32_Sym * )( symtab + ( ii * syment ) );
-
-    if ( symbol->st_shndx == SHN_UNDEF ) {
-      void * const resolved = _elf_tree_find( _ELF_H( handle ), _elf_hash( strtab + symbol->st_name ) );
+  for ( Elf_Size ii = 1; ii < handle->symCount; ii++ ) {
+    const Elf_Sym * const symbol = &handle->symtab[ii];
+    const uint8_t type = ELF_ST_TYPE( symbol->st_info );
+    uintptr_t addr = symbol->st_value;
 
-      if ( !resolved && !( ELF32_ST_BIND( symbol->st_info ) & STB_WEAK ) ) {
-        _ELF_H( handle )->flags |= _ELF_ERROR;
-        _ELF_H( handle )->error = _elf_error_unresolved_symbol;
-        return;
-      }
+    if ( type == STT_FUNC ) {
+      addr &= ~( uintptr_t )1; /* Thumb */
+    } else if ( type != STT_OBJECT ) {
+      continue;
+    }
 
-      symbol->st_shndx = SHN_ABS;
-      symbol->st_value = ( Elf32_Addr )resolved;
-    } else if (symbol->st_shndx < SHN_LORESERVE) {
-      symbol->st_shndx = SHN_ABS;
-      symbol->st_value = ( Elf32_Addr )( symbol->st_value + ( uintptr_t )buf );
-    } else if ( symbol->st_shndx != SHN_ABS ) {
-      _ELF_H( handle )->flags |= _ELF_ERROR;
-      _ELF_H( handle )->error = _elf_error_unimplemented_st_shndx;
-      return;
+    if ( addr >= low && addr < high ) {
+      handle->addrIndex[length].addr = addr;
+      handle->addrIndex[length].index = ii;
+      length++;
     }
+  }
 
-    if ( ELF32_ST_BIND( symbol->st_info ) & STB_GLOBAL ) {
-      elf_mapsym( handle, strtab + symbol->st_name, ( void * )symbol->st_value );
+  qsort( handle->addrIndex, length, sizeof( *handle->addrIndex ), _elf_addr_compare );
+
+  /* Zero sized symbols only cover their own address */
+  uintptr_t reach = 0;
+  for ( Elf_Size ii = 0; ii < length; ii++ ) {
+    const Elf_Size size = handle->symtab[handle->addrIndex[ii].index].st_size;
+    const uintptr_t end = handle->addrIndex[ii].addr + ( size ? size : 1 );
+
+    if ( end > reach ) {
+      reach = end;
     }
+
+    handle->addrIndex[ii].reach = reach;
   }
 
-  /* Actual symbol relocation */
-  if ( reltab ) {
-    if ( !relsz || !relent ) {
-      _ELF_H( handle )->flags |= _ELF_ERROR;
-      _ELF_H( handle )->error = _elf_error_zero_sized_rel;
-      return;
+  handle->addrLength = length;
+}
+
+/**
+ * Reads a little endian 32 bit word from a byte stream
+ * @param  src Unaligned source bytes
+ * @return     Word value
+ */
+inline static uint32_t _elf_read32( const uint8_t * src ) {
+  return ( uint32_t )src[0] | ( ( uint32_t )src[1] << 8 ) | ( ( uint32_t )src[2] << 16 ) | ( ( uint32_t )src[3] << 24 );
+}
+
+/**
+ * Decodes LZ4 sequences of the current block, appending to previously decoded output
+ * matches may reach back into earlier blocks, so base..out must hold all earlier output
+ * decoding pauses, without error, once out reaches stop, even in the middle of a sequence
+ * @param  lz4  Decoder state, src is inside a compressed block
+ * @param  stop End of writable output for this call
+ * @return      Error Cstring or NULL on success
+ */
+static const char * _elf_lz4_block( Elf_lz4 * lz4, uint8_t * stop ) {
+  const uint8_t * const end = lz4->blockEnd;
+
+  for ( ;; ) {
+    if ( lz4->literals ) {
+      const size_t copy = ( lz4->literals < ( size_t )( stop - lz4->out ) ? lz4->literals : ( size_t )( stop - lz4->out ) );
+
+      memcpy( lz4->out, lz4->src, copy );
+      lz4->out += copy;
+      lz4->src += copy;
+      lz4->literals -= copy;
+
+      if ( lz4->literals ) {
+        return NULL;
+      }
     }
 
-    _elf_relocate( _ELF_H( handle ), buf, reltab, relent, relsz, symtab, syment );
+    if ( lz4->sequence ) {
+      lz4->sequence = 0;
 
-    if ( _ELF_H( handle )->flags & _ELF_ERROR ) {
-      return;
+      /* Last sequence of a block has no match */
+      if ( lz4->src >= end ) {
+        return NULL;
+      }
+
+      if ( end - lz4->src < 2 ) {
+        return _elf_error_lz4;
+      }
+
+      const size_t offset = lz4->src[0] | ( lz4->src[1] << 8 );
+      size_t match = lz4->token & 15;
+
+      lz4->src += 2;
+
+      if ( match == 15 ) {
+        uint8_t more;
+
+        do {
+          if ( lz4->src >= end ) {
+            return _elf_error_lz4;
+          }
+
+          more = *lz4->src++;
+          match += more;
+        } while ( more == 255 );
+      }
+
+      if ( !offset || offset > ( size_t )( lz4->out - lz4->base ) ) {
+        return _elf_error_lz4;
+      }
+
+      lz4->offset = offset;
+      lz4->match = match + LZ4_MIN_MATCH;
     }
-  }
 
-  /* Actual jump table relocation */
-  if ( jmpReltab ) {
-    _elf_relocate( _ELF_H( handle ), buf, jmpReltab, sizeof( Elf32_Rel ), pltrelsz, symtab, syment );
+    if ( lz4->match ) {
+      size_t copy = ( lz4->match < ( size_t )( stop - lz4->out ) ? lz4->match : ( size_t )( stop - lz4->out ) );
+      const uint8_t * from = lz4->out - lz4->offset;
 
-    if ( _ELF_H( handle )->flags & _ELF_ERROR ) {
-      return;
+      lz4->match -= copy;
+
+      if ( lz4->offset >= copy ) {
+        memcpy( lz4->out, from, copy );
+        lz4->out += copy;
+      } else {
+        /* Overlapping match repeats the last offset bytes */
+        while ( copy-- ) {
+          *lz4->out++ = *from++;
+        }
+      }
+
+      if ( lz4->match ) {
+        return NULL;
+      }
+    }
+
+    if ( lz4->src >= end || lz4->out >= stop ) {
+      return NULL;
+    }
+
+    const uint8_t token = *lz4->src++;
+    size_t literals = token >> 4;
+
+    if ( literals == 15 ) {
+      uint8_t more;
+
+      do {
+        if ( lz4->src >= end ) {
+          return _elf_error_lz4;
+        }
+
+        more = *lz4->src++;
+        literals += more;
+      } while ( more == 255 );
+    }
+
+    if ( literals > ( size_t )( end - lz4->src ) ) {
+      return _elf_error_lz4;
     }
+
+    lz4->token = token;
+    lz4->literals = literals;
+    lz4->sequence = 1;
+  }
+}
+
+/**
+ * Starts decoding an LZ4 frame into contiguous memory
+ * @param  lz4   Decoder state to initialize
+ * @param  frame LZ4 frame
+ * @param  base  Output memory
+ * @return       Error Cstring or NULL on success
+ */
+static const char * _elf_lz4_begin( Elf_lz4 * lz4, const uint8_t * frame, uint8_t * base ) {
+  if ( _elf_read32( frame ) != LZ4F_MAGIC ) {
+    return _elf_error_lz4;
   }
 
-  /* Once the ELF is linked, it is safe to call the library constructors */
-  for ( Elf32_Word ii = 0; ii < initLength; ii++ ) {
-    ( *initArray[ii] )();
+  const uint8_t flg = frame[4];
+
+  if ( ( flg & LZ4F_FLG_VERSION ) != LZ4F_FLG_VERSION_01 || ( flg & LZ4F_FLG_DICT_ID ) ) {
+    return _elf_error_lz4;
   }
+
+  /* Magic, FLG, BD, optional content size and the header checksum */
+  lz4->src = frame + 4 + 2 + ( ( flg & LZ4F_FLG_CONTENT_SIZE ) ? 8 : 0 ) + 1;
+  lz4->blockEnd = NULL;
+  lz4->base = base;
+  lz4->out = base;
+  lz4->literals = 0;
+  lz4->match = 0;
+  lz4->offset = 0;
+  lz4->token = 0;
+  lz4->sequence = 0;
+  lz4->flg = flg;
+  lz4->raw = 0;
+  lz4->end = 0;
+  return NULL;
 }
 
 /**
- * Find ELF symbol
- * used to locate ELF symbols such as function pointers
- * must not be called before elf_link
- * @param  handle Valid, open ELF context
- * @param  symbol Cstring name that will be searched for within ELF
- * @return        Symbol data
+ * Continues decoding an LZ4 frame started by _elf_lz4_begin
+ * stops at limit, at the end of the frame, or once budget bytes were decoded
+ * @param  lz4    Decoder state
+ * @param  limit  Number of bytes wanted from the start of the output
+ * @param  budget Number of bytes to decode in this call
+ * @return        Error Cstring or NULL on success
  */
-void * elf_dlsym( void * handle, const char * symbol ) {
-  return _elf_tree_find( _ELF_H( handle ), _elf_hash( symbol ) );
+static const char * _elf_lz4_run( Elf_lz4 * lz4, size_t limit, size_t budget ) {
+  uint8_t * const end = lz4->base + limit;
+  uint8_t * const stop = ( budget < ( size_t )( end - lz4->out ) ? lz4->out + budget : end );
+
+  while ( lz4->out < stop && !lz4->end ) {
+    if ( !lz4->blockEnd ) {
+      const uint32_t block = _elf_read32( lz4->src );
+
+      lz4->src += 4;
+
+      /* End mark */
+      if ( !block ) {
+        lz4->end = 1;
+        break;
+      }
+
+      lz4->raw = ( ( block & LZ4F_BLOCK_UNCOMPRESSED ) != 0 );
+      lz4->blockEnd = lz4->src + ( block & ~LZ4F_BLOCK_UNCOMPRESSED );
+    }
+
+    if ( lz4->raw ) {
+      size_t copy = lz4->blockEnd - lz4->src;
+
+      if ( copy > ( size_t )( stop - lz4->out ) ) {
+        copy = stop - lz4->out;
+      }
+
+      memcpy( lz4->out, lz4->src, copy );
+      lz4->out += copy;
+      lz4->src += copy;
+    } else {
+      const char * const error = _elf_lz4_block( lz4, stop );
+
+      if ( error ) {
+        return error;
+      }
+    }
+
+    if ( lz4->src >= lz4->blockEnd && !lz4->literals && !lz4->match ) {
+      lz4->src = lz4->blockEnd + ( ( lz4->flg & LZ4F_FLG_BLOCK_CSUM ) ? 4 : 0 );
+      lz4->blockEnd = NULL;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Decodes the start of an LZ4 frame into contiguous memory
+ * output is the decompressed file from offset zero, ending at limit or the end of the frame
+ * @param  frame  LZ4 frame
+ * @param  base   Output memory
+ * @param  limit  Number of bytes wanted
+ * @param  length Receives number of bytes decoded
+ * @return        Error Cstring or NULL on success
+ */
+static const char * _elf_lz4_frame( const uint8_t * frame, uint8_t * base, size_t limit, size_t * length ) {
+  Elf_lz4 lz4;
+  const char * error = _elf_lz4_begin( &lz4, frame, base );
+
+  if ( error ) {
+    return error;
+  }
+
+  error = _elf_lz4_run( &lz4, limit, limit );
+  *length = lz4.out - base;
+  return error;
+}
+
+/**
+ * Decompresses the file and program headers of an ELF_RTLD_LZ4 source
+ * the header is decoded first to learn how far the program headers reach
+ * @param handle ELF context structure, source is the LZ4 frame
+ */
+static void _elf_lz4_headers( Elf_handle * handle ) {
+  size_t need = sizeof( Elf_Ehdr );
+  size_t length = 0;
+
+  for ( ;; ) {
+    uint8_t * const prefix = ( uint8_t * )handle->alloc( handle->uptr, handle->header, need );
+    const char * error;
+
+    if ( !prefix ) {
+      handle->flags |= _ELF_ERROR;
+      handle->error = _elf_error_allocation;
+      return;
+    }
+
+    handle->header = ( Elf_Ehdr * )prefix;
+    error = _elf_lz4_frame( ( const uint8_t * )handle->source, prefix, need, &length );
+
+    if ( error || length < need ) {
+      handle->flags |= _ELF_ERROR;
+      handle->error = ( error ? error : _elf_error_lz4 );
+      return;
+    }
+
+    const size_t headers = handle->header->e_phoff + handle->header->e_phnum * sizeof( Elf_Phdr );
+
+    if ( headers <= need ) {
+      return;
+    }
+
+    need = headers;
+  }
+}
+
+/**
+ * Describes a kept table by its virtual address and allocates its copy
+ * tables outside the file backed part of a PT_LOAD segment are left unavailable
+ * @param  handle ELF context structure
+ * @param  index  _ELF_KEEP_* table
+ * @param  vaddr  Virtual address of the table
+ * @param  size   Byte length of the table
+ * @return        Error Cstring or NULL on success
+ */
+static const char * _elf_keep_range( Elf_handle * handle, int index, Elf_Addr vaddr, size_t size ) {
+  Elf_keptTable * const table = &handle->kept[index];
+
+  if ( !size ) {
+    return NULL;
+  }
+
+  for ( Elf_Half ii = 0; ii < handle->header->e_phnum; ii++ ) {
+    Elf_Phdr * const h = ELF_PH_GET( handle->header, ii );
+
+    if ( h->p_type == PT_LOAD && vaddr >= h->p_vaddr && vaddr - h->p_vaddr <= h->p_filesz && size <= h->p_filesz - ( vaddr - h->p_vaddr ) ) {
+      table->data = ( uint8_t * )_elf_malloc( handle, size );
+      if ( !table->data ) {
+        return _elf_error_allocation;
+      }
+
+      table->vaddr = vaddr;
+      table->offset = h->p_offset + ( vaddr - h->p_vaddr );
+      table->size = size;
+      table->copied = 0;
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Copies the decoded part of the source into the kept tables
+ * tables are filled front to back, bytes are taken from anywhere in the window
+ * the symbol table is sized from the hash table header as soon as it is complete
+ * @param  handle ELF context structure
+ * @param  window Decoded bytes
+ * @param  start  File offset of window[0]
+ * @param  end    File offset one past the last decoded byte
+ * @return        Error Cstring or NULL on success
+ */
+static const char * _elf_keep_copy( Elf_handle * handle, const uint8_t * window, size_t start, size_t end ) {
+  for ( int ii = 0; ii < _ELF_KEEP_COUNT; ii++ ) {
+    Elf_keptTable * const table = &handle->kept[ii];
+    const size_t from = table->offset + table->copied;
+
+    if ( !table->data || table->copied >= table->size || from < start || from >= end ) {
+      continue;
+    }
+
+    const size_t length = ( table->offset + table->size < end ? table->offset + table->size : end ) - from;
+
+    memcpy( table->data + table->copied, window + ( from - start ), length );
+    table->copied += length;
+
+    if ( ii == _ELF_KEEP_HASH && table->copied >= table->size && handle->kept[_ELF_KEEP_SYMTAB].vaddr ) {
+      const Elf32_Word * const hash = ( const Elf32_Word * )table->data;
+      const char * const error = _elf_keep_range( handle, _ELF_KEEP_SYMTAB, handle->kept[_ELF_KEEP_SYMTAB].vaddr, hash[1] * sizeof( Elf_Sym ) );
+
+      if ( error ) {
+        return error;
+      }
+
+      /* The symbol table may start before the hash table, look again */
+      ii = -1;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Decodes the source once, as far as the last unfinished kept table
+ * the window slides once full, keeping the bytes later matches may refer to
+ * @param  handle     ELF context structure
+ * @param  window     Scratch memory
+ * @param  windowSize Byte length of window, all of the file or more than LZ4_MAX_OFFSET
+ * @return            Error Cstring or NULL on success
+ */
+static const char * _elf_keep_pass( Elf_handle * handle, uint8_t * window, size_t windowSize ) {
+  size_t need = 0, start = 0;
+  Elf_lz4 lz4;
+
+  for ( int ii = 0; ii < _ELF_KEEP_COUNT; ii++ ) {
+    const Elf_keptTable * const table = &handle->kept[ii];
+
+    if ( table->data && table->copied < table->size && table->offset + table->size > need ) {
+      need = table->offset + table->size;
+    }
+  }
+
+  if ( !need ) {
+    return NULL;
+  }
+
+  const char * error = _elf_lz4_begin( &lz4, ( const uint8_t * )handle->source, window );
+
+  while ( !error ) {
+    const size_t limit = ( need - start < windowSize ? need - start : windowSize );
+
+    error = _elf_lz4_run( &lz4, limit, limit );
+
+    if ( !error ) {
+      error = _elf_keep_copy( handle, window, start, start + ( lz4.out - window ) );
+    }
+
+    if ( error || start + ( size_t )( lz4.out - window ) >= need ) {
+      break;
+    }
+
+    /* Frame ended before the tables */
+    if ( lz4.end ) {
+      return _elf_error_lz4;
+    }
+
+    if ( lz4.out == window + windowSize ) {
+      memmove( window, lz4.out - LZ4_MAX_OFFSET, LZ4_MAX_OFFSET );
+      start += windowSize - LZ4_MAX_OFFSET;
+      lz4.out = window + LZ4_MAX_OFFSET;
+    }
+  }
+
+  return error;
+}
+
+/**
+ * Decompresses the dynamic, hash, symbol, string and relocation tables of an ELF_RTLD_LZ4 source
+ * the first pass reaches the dynamic section, the next ones the tables it lists
+ * a symbol table found before the hash table takes one more pass
+ * tables the source does not have, or that are not file backed, stay unavailable
+ * @param handle ELF context structure, headers are decompressed
+ */
+static void _elf_lz4_tables( Elf_handle * handle ) {
+  const Elf_Phdr * const dynamicSection = _elf_dynamic( handle->header );
+  size_t fileEnd = 0;
+
+  if ( !dynamicSection ) {
+    return;
+  }
+
+  for ( Elf_Half ii = 0; ii < handle->header->e_phnum; ii++ ) {
+    Elf_Phdr * const h = ELF_PH_GET( handle->header, ii );
+
+    if ( h->p_type == PT_LOAD && h->p_offset + h->p_filesz > fileEnd ) {
+      fileEnd = h->p_offset + h->p_filesz;
+    }
+  }
+
+  if ( !fileEnd ) {
+    return;
+  }
+
+  const size_t windowSize = ( fileEnd < LZ4_MAX_OFFSET + _ELF_KEEP_CHUNK ? fileEnd : LZ4_MAX_OFFSET + _ELF_KEEP_CHUNK );
+  uint8_t * const window = ( uint8_t * )_elf_malloc( handle, windowSize );
+  const char * error = ( window ? NULL : _elf_error_allocation );
+
+  if ( !error ) {
+    error = _elf_keep_range( handle, _ELF_KEEP_DYNAMIC, dynamicSection->p_vaddr, dynamicSection->p_filesz );
+  }
+
+  if ( !error ) {
+    error = _elf_keep_pass( handle, window, windowSize );
+  }
+
+  const Elf_keptTable * const dynamic = &handle->kept[_ELF_KEEP_DYNAMIC];
+
+  if ( !error && dynamic->data && dynamic->copied == dynamic->size ) {
+    const Elf_Dyn * const dynamics = ( const Elf_Dyn * )dynamic->data;
+    Elf_Addr hash = 0, strtab = 0, reltab = 0, jmpReltab = 0;
+    Elf_Size strsz = 0, relsz = 0, pltrelsz = 0;
+
+    for ( size_t ii = 0; ii < dynamic->size / sizeof( Elf_Dyn ) && dynamics[ii].d_tag != DT_NULL; ii++ ) {
+      switch ( dynamics[ii].d_tag ) {
+      case DT_HASH:
+        hash = dynamics[ii].d_un.d_ptr;
+        break;
+      case DT_SYMTAB:
+        handle->kept[_ELF_KEEP_SYMTAB].vaddr = dynamics[ii].d_un.d_ptr;
+        break;
+      case DT_STRTAB:
+        strtab = dynamics[ii].d_un.d_ptr;
+        break;
+      case DT_STRSZ:
+        strsz = dynamics[ii].d_un.d_val;
+        break;
+      case DT_RELTAB:
+        reltab = dynamics[ii].d_un.d_ptr;
+        break;
+      case DT_RELTABSZ:
+        relsz = dynamics[ii].d_un.d_val;
+        break;
+      case DT_JMPREL:
+        jmpReltab = dynamics[ii].d_un.d_ptr;
+        break;
+      case DT_PLTRELSZ:
+        pltrelsz = dynamics[ii].d_un.d_val;
+        break;
+      }
+    }
+
+    if ( hash ) {
+      error = _elf_keep_range( handle, _ELF_KEEP_HASH, hash, 2 * sizeof( Elf32_Word ) );
+    }
+
+    if ( !error && strtab ) {
+      error = _elf_keep_range( handle, _ELF_KEEP_STRTAB, strtab, strsz );
+    }
+
+    if ( !error && reltab ) {
+      error = _elf_keep_range( handle, _ELF_KEEP_RELTAB, reltab, relsz );
+    }
+
+    if ( !error && jmpReltab ) {
+      error = _elf_keep_range( handle, _ELF_KEEP_JMPRELTAB, jmpReltab, pltrelsz );
+    }
+
+    for ( int pass = 0; pass < 2 && !error; pass++ ) {
+      error = _elf_keep_pass( handle, window, windowSize );
+    }
+  }
+
+  if ( window ) {
+    _elf_free( handle, window );
+  }
+
+  if ( error ) {
+    handle->flags |= _ELF_ERROR;
+    handle->error = error;
+  }
+}
+
+/**
+ * Checks that an ELF_RTLD_LZ4 source can be decoded in place in link memory
+ * the file is decoded at buf + low + file offset, then segments are moved up to buf + p_vaddr
+ * nothing below buf + low (the lowest loaded address) is written, as elf_packlink requires
+ * @param  handle  ELF context structure
+ * @param  fileEnd Receives the number of file bytes to decode
+ * @param  low     Receives the lowest loaded address, where file offset zero is decoded
+ * @return         Error Cstring or NULL on success
+ */
+static const char * _elf_lz4_layout( Elf_handle * handle, size_t * fileEnd, size_t * low ) {
+  const Elf_Ehdr * const header = handle->header;
+  size_t lastOffset = 0, high;
+
+  *fileEnd = 0;
+  _elf_image_extent( handle, low, &high );
+
+  /* In place decoding requires segments in file order that only move up */
+  for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+    Elf_Phdr * const h = ELF_PH_GET( header, ii );
+
+    if ( h->p_type == PT_LOAD ) {
+      if ( h->p_vaddr - *low < h->p_offset || h->p_offset < lastOffset ) {
+        return _elf_error_layout;
+      }
+
+      lastOffset = h->p_offset;
+      *fileEnd = h->p_offset + h->p_filesz;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Moves the segments of an in place decoded ELF_RTLD_LZ4 source to their addresses and clears their bss
+ * segments are placed from the highest down, so nothing is overwritten before it has moved
+ * each segment moves from its end down in chunks, then its bss is cleared, resuming at link segment and offset
+ * @param  handle ELF context structure
+ * @param  low    Lowest loaded address, where file offset zero was decoded
+ * @param  budget Byte count allowed
+ * @return        Bytes moved or cleared
+ */
+static size_t _elf_lz4_place( Elf_handle * handle, size_t low, size_t budget ) {
+  const Elf_Ehdr * const header = handle->header;
+  Elf_linkState * const link = &handle->link;
+  const uintptr_t buf = ( uintptr_t )link->buf;
+  size_t used = 0;
+
+  while ( used < budget && link->segment > 0 ) {
+    Elf_Phdr * const h = ELF_PH_GET( header, link->segment - 1 );
+
+    if ( h->p_type != PT_LOAD || link->offset >= h->p_memsz ) {
+      link->segment--;
+      link->offset = 0;
+      continue;
+    }
+
+    size_t length;
+
+    if ( link->offset < h->p_filesz ) {
+      /* Already in place */
+      if ( h->p_vaddr == low + h->p_offset ) {
+        link->offset = h->p_filesz;
+        continue;
+      }
+
+      const size_t end = h->p_filesz - link->offset;
+
+      length = ( end < budget - used ? end : budget - used );
+      memmove( ( void * )( buf + h->p_vaddr + end - length ), ( void * )( buf + low + h->p_offset + end - length ), length );
+    } else {
+      length = h->p_memsz - link->offset;
+      length = ( length < budget - used ? length : budget - used );
+      memset( ( void * )( buf + h->p_vaddr + link->offset ), 0, length );
+    }
+
+    link->offset += length;
+    used += length;
+  }
+
+  return used;
+}
+
+/**
+ * Marks the imported symbols of a range of the dynamic symbol table
+ * must run before the range is resolved, resolution rewrites st_shndx
+ * @param handle ELF context structure
+ * @param begin  Index of first symbol
+ * @param end    Index one past the last symbol
+ */
+static void _elf_rebind_mark( Elf_handle * handle, Elf_Size begin, Elf_Size end ) {
+  for ( Elf_Size ii = begin; ii < end; ii++ ) {
+    if ( handle->symtab[ii].st_shndx == SHN_UNDEF ) {
+      handle->link.imports[ii >> 3] |= ( uint8_t )( 1 << ( ii & 7 ) );
+    }
+  }
+}
+
+/**
+ * Records the slots of a range of relocations that reference marked imports
+ * @param  handle ELF context structure
+ * @param  reltab Relocation table
+ * @param  begin  Index of first relocation
+ * @param  end    Index one past the last relocation
+ * @return        Error Cstring or NULL on success
+ */
+static const char * _elf_rebind_record( Elf_handle * handle, const Elf_Rel * reltab, Elf_Size begin, Elf_Size end ) {
+  for ( Elf_Size ii = begin; ii < end; ii++ ) {
+    const Elf_Size index = ELF_R_SYM( reltab[ii].r_info );
+
+    if ( !( handle->link.imports[index >> 3] & ( 1 << ( index & 7 ) ) ) ) {
+      continue;
+    }
+
+    if ( handle->rebindLength == handle->rebindCapacity ) {
+      const Elf_Size capacity = ( handle->rebindCapacity ? handle->rebindCapacity * 2 : 16 );
+      Elf_rebindSlot * const rebinds = ( Elf_rebindSlot * )handle->alloc( handle->uptr, handle->rebinds, sizeof( *rebinds ) * capacity );
+
+      if ( !rebinds ) {
+        return _elf_error_allocation;
+      }
+
+      handle->rebinds = rebinds;
+      handle->rebindCapacity = capacity;
+    }
+
+    Elf_rebindSlot * const record = &handle->rebinds[handle->rebindLength++];
+
+    record->hash = _elf_hash( handle->strtab + handle->symtab[index].st_name );
+    record->symbol = index;
+    record->slot = ( Elf_Addr * )( ( uintptr_t )handle->link.buf + reltab[ii].r_offset );
+    record->thunk = NULL;
+  }
+
+  return NULL;
+}
+
+/**
+ * Comparison function for sorting rebind slots by slot address
+ */
+static int _elf_rebind_compare_slot( const void * a, const void * b ) {
+  const uintptr_t lhs = ( uintptr_t )( ( const Elf_rebindSlot * )a )->slot;
+  const uintptr_t rhs = ( uintptr_t )( ( const Elf_rebindSlot * )b )->slot;
+
+  return ( lhs > rhs ) - ( lhs < rhs );
+}
+
+/**
+ * Comparison function for sorting rebind slots by hash, then symbol index, then slot address
+ */
+static int _elf_rebind_compare_hash( const void * a, const void * b ) {
+  const Elf_rebindSlot * const lhs = ( const Elf_rebindSlot * )a;
+  const Elf_rebindSlot * const rhs = ( const Elf_rebindSlot * )b;
+
+  if ( lhs->hash != rhs->hash ) {
+    return ( lhs->hash > rhs->hash ) - ( lhs->hash < rhs->hash );
+  }
+
+  if ( lhs->symbol != rhs->symbol ) {
+    return ( lhs->symbol > rhs->symbol ) - ( lhs->symbol < rhs->symbol );
+  }
+
+  return _elf_rebind_compare_slot( a, b );
+}
+
+/**
+ * Attaches profiling thunks to their jump slots and sorts the slots for lookup by name
+ * @param handle ELF context structure
+ */
+static void _elf_rebind_finish( Elf_handle * handle ) {
+  _elf_free( handle, handle->link.imports );
+  handle->link.imports = NULL;
+
+  if ( handle->thunkLength ) {
+    qsort( handle->rebinds, handle->rebindLength, sizeof( *handle->rebinds ), _elf_rebind_compare_slot );
+
+    for ( Elf_Size ii = 0; ii < handle->thunkLength; ii++ ) {
+      const uintptr_t slot = ( uintptr_t )handle->thunks[ii].slot;
+      Elf_Size lower = 0, upper = handle->rebindLength;
+
+      /* First record at or after the thunk slot */
+      while ( lower < upper ) {
+        const Elf_Size middle = lower + ( upper - lower ) / 2;
+
+        if ( ( uintptr_t )handle->rebinds[middle].slot < slot ) {
+          lower = middle + 1;
+        } else {
+          upper = middle;
+        }
+      }
+
+      if ( lower < handle->rebindLength && ( uintptr_t )handle->rebinds[lower].slot == slot ) {
+        handle->rebinds[lower].thunk = &handle->thunks[ii];
+      }
+    }
+  }
+
+  qsort( handle->rebinds, handle->rebindLength, sizeof( *handle->rebinds ), _elf_rebind_compare_hash );
+}
+
+/**
+ * Abandons the link in progress with an error
+ * @param handle ELF context structure
+ * @param error  Error Cstring
+ */
+static void _elf_link_fail( Elf_handle * handle, const char * error ) {
+  handle->flags |= _ELF_ERROR;
+  handle->error = error;
+  handle->link.phase = ELF_LINK_IDLE;
+  handle->link.done = 0;
+  handle->link.total = 0;
+
+  if ( handle->link.imports ) {
+    _elf_free( handle, handle->link.imports );
+    handle->link.imports = NULL;
+  }
+}
+
+/**
+ * Starts a link, the first phase copies the loaded segments
+ * @param handle ELF context structure
+ * @param buf    Link memory
+ */
+static void _elf_link_begin( Elf_handle * handle, void * buf ) {
+  const Elf_Ehdr * const header = handle->header;
+  Elf_linkState * const link = &handle->link;
+
+  link->phase = ELF_LINK_COPY;
+  link->buf = buf;
+  link->segment = 0;
+  link->offset = 0;
+  link->done = 0;
+  link->total = 0;
+
+  /* Decoded bytes, then bytes moved into place and bss bytes cleared */
+  if ( handle->flags & ELF_RTLD_LZ4 ) {
+    size_t low;
+    const char * error = _elf_lz4_layout( handle, &link->fileEnd, &low );
+
+    if ( !error ) {
+      error = _elf_lz4_begin( &link->lz4, ( const uint8_t * )handle->source, ( uint8_t * )buf + low );
+    }
+
+    if ( error ) {
+      _elf_link_fail( handle, error );
+      return;
+    }
+
+    link->segment = header->e_phnum;
+    link->total = link->fileEnd;
+
+    for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+      Elf_Phdr * const h = ELF_PH_GET( header, ii );
+
+      if ( h->p_type == PT_LOAD ) {
+        link->total += ( h->p_vaddr != low + h->p_offset ? h->p_memsz : h->p_memsz - h->p_filesz );
+      }
+    }
+
+    return;
+  }
+
+  for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+    Elf_Phdr * const h = ELF_PH_GET( header, ii );
+
+    if ( h->p_type == PT_LOAD ) {
+      link->total += h->p_memsz;
+    }
+  }
+}
+
+/**
+ * Reads the dynamic section of the copied image, then moves on to symbol resolution
+ * tables are read from the linked copy
+ * @param handle ELF context structure
+ */
+static void _elf_link_tables( Elf_handle * handle ) {
+  Elf_linkState * const link = &handle->link;
+  void * const buf = link->buf;
+  const Elf_Phdr * const dynamicSection = _elf_dynamic( handle->header );
+
+  /* Dynamic section is kind of important for dynamic libraries */
+  if ( !dynamicSection ) {
+    _elf_link_fail( handle, _elf_error_dynamic_section );
+    return;
+  }
+
+  Elf_Size pltrelsz = 0, strsz = 0, syment = 0, relsz = 0, relent = 0, initLength = 0;
+  const Elf_Rel * reltab = NULL;
+  const Elf_Rel * jmpReltab = NULL;
+  Elf_Sym * symtab = NULL;
+  const Elf32_Word * hash = NULL;
+  const char * strtab = NULL;
+  elf_voidf * initArray = NULL;
+
+  /* Pull out the table information from the dynamic section */
+  /* this will be used for dynamic relocation */
+  for ( Elf_Dyn * dynamics = ( Elf_Dyn * )( ( uintptr_t )buf + dynamicSection->p_vaddr ); dynamics->d_tag != DT_NULL; dynamics++) {
+    switch ( dynamics->d_tag ) {
+    case DT_NEEDED: /* Dependencies are not supported, so return */
+      _elf_link_fail( handle, _elf_error_dependency );
+      return;
+    case DT_PLTRELSZ:
+      pltrelsz = dynamics->d_un.d_val;
+      break;
+    case DT_HASH:
+      hash = ( Elf32_Word * )( ( uintptr_t )buf + dynamics->d_un.d_ptr );
+      break;
+    case DT_STRTAB:
+      strtab = ( const char * )( ( uintptr_t )buf + dynamics->d_un.d_ptr );
+      break;
+    case DT_SYMTAB:
+      symtab = ( Elf_Sym * )( ( uintptr_t )buf + dynamics->d_un.d_ptr );
+      break;
+    case DT_STRSZ:
+      strsz = dynamics->d_un.d_val;
+      break;
+    case DT_SYMENT:
+      syment = dynamics->d_un.d_val;
+      break;
+    case DT_RELTAB:
+      reltab = ( Elf_Rel * )( ( uintptr_t )buf + dynamics->d_un.d_ptr );
+      break;
+    case DT_RELTABSZ:
+      relsz = dynamics->d_un.d_val;
+      break;
+    case DT_RELTABENT:
+      relent = dynamics->d_un.d_val;
+      break;
+    case DT_JMPREL:
+      jmpReltab = ( Elf_Rel * )( ( uintptr_t )buf + dynamics->d_un.d_ptr );
+      break;
+    case DT_INIT_ARRAY:
+      initArray = ( elf_voidf * )( dynamics->d_un.d_ptr + ( uintptr_t )buf );
+      break;
+    case DT_INIT_ARRAYSZ:
+      initLength = dynamics->d_un.d_val / sizeof( Elf_Addr );
+      break;
+    case DT_FINI_ARRAY:
+      handle->finiArray = ( elf_voidf * )( dynamics->d_un.d_ptr + ( uintptr_t )buf );
+      break;
+    case DT_FINI_ARRAYSZ:
+      handle->finiLength = dynamics->d_un.d_val / sizeof( Elf_Addr );
+      break;
+    case DT_PLTGOT: /* Ignore these sections */
+    case DT_INIT:
+    case DT_FINI:
+    case DT_PLTREL:
+    case DT_TEXTREL:
+    case DT_RELTABCOUNT:
+      break;
+    default:
+      _elf_link_fail( handle, _elf_error_d_tag );
+      return;
+    }
+  }
+
+  if ( !hash || !strtab || !symtab || !syment || !strsz ) {
+    _elf_link_fail( handle, _elf_error_missing_entries );
+    return;
+  }
+
+  /* Symbol and relocation tables are indexed with a fixed stride */
+  if ( syment != sizeof( Elf_Sym ) || ( relent && relent != sizeof( Elf_Rel ) ) ) {
+    _elf_link_fail( handle, _elf_error_entry_size );
+    return;
+  }
+
+  if ( reltab && ( !relsz || !relent ) ) {
+    _elf_link_fail( handle, _elf_error_zero_sized_rel );
+    return;
+  }
+
+  /* Remembered for elf_dladdr */
+  if ( handle->addrIndex ) {
+    _elf_free( handle, handle->addrIndex );
+    handle->addrIndex = NULL;
+    handle->addrLength = 0;
+  }
+
+  handle->linkBuf = buf;
+  handle->symtab = symtab;
+  handle->symCount = hash[1];
+  handle->strtab = strtab;
+  handle->thunks = NULL;
+  handle->thunkLength = 0;
+  handle->rebindLength = 0;
+
+  /* Imports are marked during resolution, so their relocation slots can be recorded */
+  if ( handle->flags & ELF_RTLD_REBIND ) {
+    const size_t length = ( hash[1] + 7 ) / 8;
+
+    if ( link->imports ) {
+      _elf_free( handle, link->imports );
+    }
+
+    link->imports = ( uint8_t * )_elf_malloc( handle, length );
+    if ( !link->imports ) {
+      _elf_link_fail( handle, _elf_error_allocation );
+      return;
+    }
+
+    memset( link->imports, 0, length );
+  }
+
+  link->reltab = reltab;
+  link->relCount = ( reltab ? relsz / sizeof( Elf_Rel ) : 0 );
+  link->jmpReltab = jmpReltab;
+  link->jmpCount = ( jmpReltab ? pltrelsz / sizeof( Elf_Rel ) : 0 );
+  link->initArray = initArray;
+  link->initLength = ( initArray ? initLength : 0 );
+
+  link->phase = ELF_LINK_RESOLVE;
+  link->done = 0;
+  link->total = ( hash[1] ? hash[1] - 1 : 0 );
+}
+
+/**
+ * Copies, or decompresses, up to budget bytes of the loaded segments
+ * @param  handle ELF context structure
+ * @param  budget Byte count allowed
+ * @return        Bytes written
+ */
+static size_t _elf_link_copy( Elf_handle * handle, size_t budget ) {
+  const Elf_Ehdr * const header = handle->header;
+  Elf_linkState * const link = &handle->link;
+  size_t used = 0;
+
+  if ( handle->flags & ELF_RTLD_LZ4 ) {
+    const size_t low = link->lz4.base - ( uint8_t * )link->buf;
+
+    if ( link->done < link->fileEnd ) {
+      const uint8_t * const out = link->lz4.out;
+      const char * const error = _elf_lz4_run( &link->lz4, link->fileEnd, budget );
+
+      if ( error ) {
+        _elf_link_fail( handle, error );
+        return 0;
+      }
+
+      used = link->lz4.out - out;
+      link->done += used;
+
+      if ( link->done < link->fileEnd ) {
+        if ( link->lz4.end ) {
+          _elf_link_fail( handle, _elf_error_lz4 );
+        }
+
+        return used;
+      }
+    }
+
+    const size_t placed = _elf_lz4_place( handle, low, budget - used );
+
+    link->done += placed;
+    used += placed;
+
+    if ( !link->segment ) {
+      _elf_link_tables( handle );
+    }
+
+    return used;
+  }
+
+  while ( used < budget && link->segment < header->e_phnum ) {
+    Elf_Phdr * const h = ELF_PH_GET( header, link->segment );
+
+    if ( h->p_type != PT_LOAD || link->offset >= h->p_memsz ) {
+      link->segment++;
+      link->offset = 0;
+      continue;
+    }
+
+    const uintptr_t dest = ( uintptr_t )link->buf + h->p_vaddr + link->offset;
+    size_t length;
+
+    if ( link->offset < h->p_filesz ) {
+      length = h->p_filesz - link->offset;
+      length = ( length < budget - used ? length : budget - used );
+      memcpy( ( void * )dest, ( void * )( ELF_PH_CONTENT( header, h ) + link->offset ), length );
+    } else {
+      length = h->p_memsz - link->offset;
+      length = ( length < budget - used ? length : budget - used );
+      memset( ( void * )dest, 0, length );
+    }
+
+    link->offset += length;
+    used += length;
+  }
+
+  link->done += used;
+
+  if ( link->segment >= header->e_phnum ) {
+    _elf_link_tables( handle );
+  }
+
+  return used;
+}
+
+/**
+ * Finishes relocation, reports the written memory and moves on to the constructors
+ * runs within one step whatever the budget (documented with elf_link_step)
+ * @param handle ELF context structure
+ */
+static void _elf_link_finish( Elf_handle * handle ) {
+  const Elf_Ehdr * const header = handle->header;
+  Elf_linkState * const link = &handle->link;
+
+  /* Route imported calls through the profiling thunks */
+  if ( ELF_THUNKS && ( handle->flags & ELF_RTLD_PROFILE ) && link->jmpReltab ) {
+    _elf_thunk_link( handle, link->buf, link->jmpReltab, link->jmpCount * sizeof( Elf_Rel ) );
+  }
+
+  if ( link->imports ) {
+    _elf_rebind_finish( handle );
+  }
+
+  /* Every loaded segment was written, code must be visible to instruction fetch before constructors run */
+  if ( handle->flush ) {
+    Elf_flushRange range = { 0, 0, 0 };
+
+    for ( Elf_Half ii = 0; ii < header->e_phnum; ii++ ) {
+      Elf_Phdr * const h = ELF_PH_GET( header, ii );
+
+      if ( h->p_type == PT_LOAD ) {
+        _elf_flush_add( handle, &range, ( uintptr_t )link->buf + h->p_vaddr, h->p_memsz, ( h->p_flags & PF_X ) ? ELF_FLUSH_EXEC : ELF_FLUSH_DATA );
+      }
+    }
+
+    if ( handle->thunkLength ) {
+      _elf_flush_add( handle, &range, ( uintptr_t )handle->thunks, handle->thunkLength * sizeof( Elf_thunk ), ELF_FLUSH_EXEC );
+    }
+
+    _elf_flush_end( handle, &range );
+  }
+
+  link->phase = ELF_LINK_INIT;
+  link->done = 0;
+  link->total = link->initLength;
+}
+
+/**
+ * Resolves up to budget symbols
+ * with a parallel-for set, resolution and relocation are dispatched at once
+ * @param  handle ELF context structure
+ * @param  budget Symbol count allowed
+ * @return        Symbols resolved
+ */
+static size_t _elf_link_resolve( Elf_handle * handle, size_t budget ) {
+  Elf_linkState * const link = &handle->link;
+  size_t used = 0;
+
+  if ( handle->parallel && !link->done ) {
+    Elf_linkJob job;
+
+    job.handle = handle;
+    job.buf = link->buf;
+    job.symtab = handle->symtab;
+    job.symCount = handle->symCount;
+    job.strtab = handle->strtab;
+    job.reltab = link->reltab;
+    job.relCount = link->relCount;
+    job.jmpReltab = link->jmpReltab;
+    job.jmpCount = link->jmpCount;
+    job.grain = handle->grain;
+    job.errors = NULL;
+
+    if ( link->imports ) {
+      _elf_rebind_mark( handle, 1, handle->symCount );
+    }
+
+    if ( !_elf_link_parallel( &job ) ) {
+      const char * error = NULL;
+
+      if ( handle->flags & _ELF_ERROR ) {
+        _elf_link_fail( handle, handle->error );
+        return 0;
+      }
+
+      /* Slots are recorded serially, the record array is not thread safe */
+      if ( link->imports ) {
+        error = _elf_rebind_record( handle, link->reltab, 0, link->relCount );
+
+        if ( !error ) {
+          error = _elf_rebind_record( handle, link->jmpReltab, 0, link->jmpCount );
+        }
+      }
+
+      if ( error ) {
+        _elf_link_fail( handle, error );
+      } else {
+        _elf_link_finish( handle );
+      }
+
+      return 0;
+    }
+  }
+
+  /* Any global symbols added by elf_mapsym are resolved here */
+  while ( used < budget && link->done < link->total ) {
+    const Elf_Size index = 1 + link->done;
+    const Elf_Sym * const symbol = &handle->symtab[index];
+
+    if ( link->imports ) {
+      _elf_rebind_mark( handle, index, index + 1 );
+    }
+
+    const char * const error = _elf_resolve_range( handle, link->buf, handle->symtab, handle->strtab, index, index + 1 );
+
+    if ( error ) {
+      _elf_link_fail( handle, error );
+      return used;
+    }
+
+    if ( ELF_ST_BIND( symbol->st_info ) & STB_GLOBAL ) {
+      elf_mapsym( handle, handle->strtab + symbol->st_name, ( void * )symbol->st_value );
+    }
+
+    link->done++;
+    used++;
+  }
+
+  if ( link->done >= link->total ) {
+    link->phase = ELF_LINK_RELOCATE;
+    link->done = 0;
+    link->total = link->relCount + link->jmpCount;
+  }
+
+  return used;
+}
+
+/**
+ * Applies up to budget relocations, DT_REL followed by DT_JMPREL
+ * @param  handle ELF context structure
+ * @param  budget Relocation count allowed
+ * @return        Relocations applied
+ */
+static size_t _elf_link_relocate( Elf_handle * handle, size_t budget ) {
+  Elf_linkState * const link = &handle->link;
+  size_t used = 0;
+
+  while ( used < budget && link->done < link->total ) {
+    const Elf_Rel * reltab = link->reltab;
+    Elf_Size begin = link->done;
+    Elf_Size end = link->relCount;
+
+    if ( begin >= link->relCount ) {
+      reltab = link->jmpReltab;
+      begin -= link->relCount;
+      end = link->jmpCount;
+    }
+
+    if ( end - begin > budget - used ) {
+      end = begin + ( budget - used );
+    }
+
+    const char * error = _elf_relocate_range( link->buf, reltab, begin, end, handle->symtab );
+
+    if ( !error && link->imports ) {
+      error = _elf_rebind_record( handle, reltab, begin, end );
+    }
+
+    if ( error ) {
+      _elf_link_fail( handle, error );
+      return used;
+    }
+
+    link->done += end - begin;
+    used += end - begin;
+  }
+
+  if ( link->done >= link->total ) {
+    _elf_link_finish( handle );
+  }
+
+  return used;
+}
+
+/**
+ * Runs up to budget library constructors
+ * @param  handle ELF context structure
+ * @param  budget Constructor count allowed
+ * @return        Constructors run
+ */
+static size_t _elf_link_init( Elf_handle * handle, size_t budget ) {
+  Elf_linkState * const link = &handle->link;
+  size_t used = 0;
+
+  while ( used < budget && link->done < link->total ) {
+    ( *link->initArray[link->done++] )();
+    used++;
+  }
+
+  if ( link->done >= link->total ) {
+    link->phase = ELF_LINK_DONE;
+  }
+
+  return used;
+}
+
+/**
+ * Calls the library destructors once
+ * @param handle ELF context structure
+ */
+static void _elf_fini( Elf_handle * handle ) {
+  for ( Elf_Size ii = 0; ii < handle->finiLength; ii++ ) {
+    ( *handle->finiArray[ii] )();
+  }
+
+  handle->finiArray = NULL;
+  handle->finiLength = 0;
+}
+
+/**
+ * Size class holding a link buffer of the given length
+ * @param  size Byte length needed
+ * @return      Size class, buffers of the class are ( 1 << class ) bytes
+ */
+static int _elf_pool_class( size_t size ) {
+  int sizeClass = _ELF_POOL_MIN_CLASS;
+
+  while ( ( ( size_t )1 << sizeClass ) < size ) {
+    sizeClass++;
+  }
+
+  return sizeClass;
+}
+
+/**
+ * Takes a link buffer from a size class, allocating one if the class is empty
+ * @param  pool      ELF pool structure
+ * @param  sizeClass Size class
+ * @return           Link buffer, or NULL if failed
+ */
+static void * _elf_pool_acquire( Elf_pool * pool, int sizeClass ) {
+  Elf_poolBuffer * const buffer = pool->buffers[sizeClass];
+
+  if ( buffer ) {
+    pool->buffers[sizeClass] = buffer->next;
+    return buffer;
+  }
+
+  return pool->alloc( pool->uptr, NULL, ( size_t )1 << sizeClass );
+}
+
+/**
+ * Returns a link buffer to its size class
+ * @param pool      ELF pool structure
+ * @param buf       Link buffer taken with _elf_pool_acquire
+ * @param sizeClass Size class of buf
+ */
+static void _elf_pool_release( Elf_pool * pool, void * buf, int sizeClass ) {
+  Elf_poolBuffer * const buffer = ( Elf_poolBuffer * )buf;
+
+  buffer->next = pool->buffers[sizeClass];
+  pool->buffers[sizeClass] = buffer;
+}
+
+/**
+ * Finds the pool entry of an open handle
+ * @param  pool   ELF pool structure
+ * @param  handle ELF context structure
+ * @return        Entry, or NULL if the handle was not opened by the pool
+ */
+static Elf_poolEntry * _elf_pool_find( Elf_pool * pool, void * handle ) {
+  for ( size_t ii = 0; ii < pool->entryLength; ii++ ) {
+    if ( pool->entries[ii].open && pool->entries[ii].handle == handle ) {
+      return &pool->entries[ii];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Destroys the handle of a pool entry and removes the entry
+ * the link buffer goes back to its size class
+ * @param pool  ELF pool structure
+ * @param entry Entry to remove
+ */
+static void _elf_pool_evict( Elf_pool * pool, Elf_poolEntry * entry ) {
+  elf_dlclose( entry->handle );
+
+  if ( entry->buf ) {
+    _elf_pool_release( pool, entry->buf, entry->sizeClass );
+  }
+
+  *entry = pool->entries[--pool->entryLength];
+}
+
+/*
+
+  ELF implementations
+
+*/
+
+/**
+ * ELF initialization (default realloc/free)
+ * @param  buf  Pointer to ELF file in memory
+ * @param  flag ELF_RTLD_* bit flags (defined above)
+ * @return      Handle to loaded ELF context
+ */
+void * elf_dlmemopen( const void * buf, int flag ) {
+  return elf_dlmemopen_alloc( buf, flag, _elf_stdalloc, NULL );
+}
+
+/**
+ * ELF initialization (custom allocator, see elf_allocf)
+ * @param  buf   Pointer to ELF file in memory
+ * @param  flag  ELF_RTLD_* bit flags (defined above)
+ * @param  alloc Realloc with a uptr cookie
+ * @param  uptr  Cookie user pointer to be sent to elf_allocf
+ * @return       Handle to loaded ELF context
+ */
+void * elf_dlmemopen_alloc( const void * buf, int flag, elf_allocf alloc, void * uptr ) {
+  Elf_handle * const handle = ( Elf_handle * )alloc( uptr, NULL, sizeof( *handle ) );
+
+  handle->alloc = alloc;
+  handle->uptr = uptr;
+  handle->flags = flag;
+  handle->header = ( Elf_Ehdr * )buf;
+  handle->source = buf;
+  memset( handle->kept, 0, sizeof( handle->kept ) );
+  handle->globalSymbols = NULL;
+  handle->finiArray = NULL;
+  handle->finiLength = 0;
+  handle->parallel = NULL;
+  handle->parallelUptr = NULL;
+  handle->grain = _ELF_DEFAULT_GRAIN;
+  handle->linkBuf = NULL;
+  handle->symtab = NULL;
+  handle->symCount = 0;
+  handle->strtab = NULL;
+  handle->addrIndex = NULL;
+  handle->addrLength = 0;
+  handle->clock = NULL;
+  handle->clockUptr = NULL;
+  handle->thunks = NULL;
+  handle->thunkLength = 0;
+  handle->flush = NULL;
+  handle->flushUptr = NULL;
+  handle->rebinds = NULL;
+  handle->rebindLength = 0;
+  handle->rebindCapacity = 0;
+  handle->link.phase = ELF_LINK_IDLE;
+  handle->link.done = 0;
+  handle->link.total = 0;
+  handle->link.imports = NULL;
+
+  /* Headers are decompressed up front, segments are decoded straight into link memory */
+  if ( handle->flags & ELF_RTLD_LZ4 ) {
+    handle->header = NULL;
+    _elf_lz4_headers( handle );
+
+    if ( handle->flags & _ELF_ERROR ) {
+      return handle;
+    }
+  }
+
+  if ( ( handle->flags & ELF_RTLD_SKIP_CHECK ) == 0 ) {
+    _elf_check( handle );
+  }
+
+  /* Small tables stay decompressed for elf_imports and the profiling thunk count */
+  if ( ( handle->flags & ELF_RTLD_LZ4 ) && !( handle->flags & _ELF_ERROR ) ) {
+    _elf_lz4_tables( handle );
+  }
+
+  return handle;
+}
+
+/**
+ * Unlinks and destroys ELF context
+ * @param handle Valid, open ELF context
+ */
+void elf_dlclose( void * handle ) {
+  /* Call ELF destructors */
+  _elf_fini( _ELF_H( handle ) );
+
+  /* Release link map */
+  if ( _ELF_H( handle )->globalSymbols ) {
+    _elf_tree_free( _ELF_H( handle ), _ELF_H( handle )->globalSymbols );
+  }
+
+  /* Release address index */
+  if ( _ELF_H( handle )->addrIndex ) {
+    _elf_free( _ELF_H( handle ), _ELF_H( handle )->addrIndex );
+  }
+
+  /* Release rebind slots */
+  if ( _ELF_H( handle )->rebinds ) {
+    _elf_free( _ELF_H( handle ), _ELF_H( handle )->rebinds );
+  }
+
+  /* Release import map of an unfinished link */
+  if ( _ELF_H( handle )->link.imports ) {
+    _elf_free( _ELF_H( handle ), _ELF_H( handle )->link.imports );
+  }
+
+  /* Release decompressed headers */
+  if ( ( _ELF_H( handle )->flags & ELF_RTLD_LZ4 ) && _ELF_H( handle )->header ) {
+    _elf_free( _ELF_H( handle ), _ELF_H( handle )->header );
+  }
+
+  /* Release kept tables */
+  for ( int ii = 0; ii < _ELF_KEEP_COUNT; ii++ ) {
+    if ( _ELF_H( handle )->kept[ii].data ) {
+      _elf_free( _ELF_H( handle ), _ELF_H( handle )->kept[ii].data );
+    }
+  }
+
+  const elf_allocf alloc = _ELF_H( handle )->alloc;
+  void * const uptr = _ELF_H( handle )->uptr;
+
+  alloc( uptr, handle, 0 );
+}
+
+/**
+ * Get ELF error message
+ * also clears the internal error state of the ELF context
+ * @param  handle Valid, open ELF context
+ * @return        Error message as a Cstring, invalidated by subsequent elf_ calls
+ */
+const char * elf_dlerror( void * handle ) {
+  if ( _ELF_H( handle )->flags & _ELF_ERROR ) {
+    _ELF_H( handle )->flags &= ~_ELF_ERROR; /* Remove error flag */
+    return _ELF_H( handle )->error;
+  }
+
+  return NULL;
+}
+
+/**
+ * Add symbol to ELF link map
+ * required symbols referenced in the ELF should use this
+ * @param handle Valid, open ELF context
+ * @param name   Symbol name that will be used by linker
+ * @param sym    Pointer to symbol data that will be used by linker
+ */
+void elf_mapsym( void * handle, const char * name, void * sym ) {
+  const int hash = _elf_hash( name );
+
+  _elf_tree_add( _ELF_H( handle ), hash, sym );
+}
+
+/**
+ * Return memory requirements of linked ELF
+ * returned size should be used to allocate space to link ELF into
+ * @param  handle Valid, open ELF context
+ * @return        Memory byte requirement length
+ */
+size_t elf_lbounds( void * handle ) {
+  if ( _ELF_H( handle )->flags & ELF_RTLD_PROFILE ) {
+    return _elf_thunk_offset( _ELF_H( handle ) ) + _elf_thunk_count( _ELF_H( handle ) ) * sizeof( Elf_thunk );
+  }
+
+  return _elf_image_bounds( _ELF_H( handle ) );
+}
+
+/**
+ * Link ELF into given memory buffer
+ * all resolution is done in this step
+ * missing symbols must be already added by elf_mapsym
+ * @param handle Valid, open ELF context
+ * @param buf    Allocated memory of size given by elf_lbounds
+ */
+void elf_link( void * handle, void * buf ) {
+  /* Abandon any elf_link_step link in progress */
+  _ELF_H( handle )->link.phase = ELF_LINK_IDLE;
+
+  while ( elf_link_step( handle, buf, ( size_t )-1 ) ) {
+  }
+}
+
+/**
+ * Link ELF into given memory buffer, a limited amount of work at a time
+ * the first call starts the link, following calls continue it until done
+ * once linked, calls do no work and return zero, so polling is safe
+ * @param  handle Valid, open ELF context
+ * @param  buf    Allocated memory of size given by elf_lbounds, the same for every step of a link
+ * @param  budget Units of work allowed (bytes copied or decompressed and placed, symbols resolved, relocations applied, constructors run)
+ * @return        Non-zero while the link is unfinished, zero once linked or on error (see elf_dlerror)
+ */
+int elf_link_step( void * handle, void * buf, size_t budget ) {
+  if ( _ELF_H( handle )->link.phase == ELF_LINK_DONE ) {
+    return 0;
+  }
+
+  /* Only an idle handle starts a link, a linked one is relinked with elf_link */
+  if ( _ELF_H( handle )->link.phase == ELF_LINK_IDLE ) {
+    _elf_link_begin( _ELF_H( handle ), buf );
+  }
+
+  while ( budget && _ELF_H( handle )->link.phase != ELF_LINK_IDLE && _ELF_H( handle )->link.phase != ELF_LINK_DONE ) {
+    switch ( _ELF_H( handle )->link.phase ) {
+    case ELF_LINK_COPY:
+      budget -= _elf_link_copy( _ELF_H( handle ), budget );
+      break;
+    case ELF_LINK_RESOLVE:
+      budget -= _elf_link_resolve( _ELF_H( handle ), budget );
+      break;
+    case ELF_LINK_RELOCATE:
+      budget -= _elf_link_relocate( _ELF_H( handle ), budget );
+      break;
+    case ELF_LINK_INIT:
+      budget -= _elf_link_init( _ELF_H( handle ), budget );
+      break;
+    }
+  }
+
+  return ( _ELF_H( handle )->link.phase != ELF_LINK_IDLE && _ELF_H( handle )->link.phase != ELF_LINK_DONE );
+}
+
+/**
+ * Progress of the current elf_link_step link
+ * @param  handle Valid, open ELF context
+ * @param  done   Receives units of work done in the current phase
+ * @param  total  Receives units of work in the current phase
+ * @return        ELF_LINK_* phase (defined in elf.h)
+ */
+int elf_link_progress( void * handle, size_t * done, size_t * total ) {
+  *done = _ELF_H( handle )->link.done;
+  *total = _ELF_H( handle )->link.total;
+  return _ELF_H( handle )->link.phase;
+}
+
+/**
+ * Find ELF symbol
+ * used to locate ELF symbols such as function pointers
+ * must not be called before elf_link
+ * @param  handle Valid, open ELF context
+ * @param  symbol Cstring name that will be searched for within ELF
+ * @return        Symbol data
+ */
+void * elf_dlsym( void * handle, const char * symbol ) {
+  return _elf_tree_find( _ELF_H( handle ), _elf_hash( symbol ) );
+}
+
+/**
+ * Set a parallel-for dispatcher used by elf_link
+ * symbol resolution and relocation tables are split into chunks of grain entries
+ * @param handle   Valid, open ELF context
+ * @param parallel Dispatcher, or NULL to link serially
+ * @param uptr     Cookie user pointer to be sent to elf_parallelf
+ * @param grain    Table entries per task, or zero for the default
+ */
+void elf_parallel( void * handle, elf_parallelf parallel, void * uptr, size_t grain ) {
+  _ELF_H( handle )->parallel = parallel;
+  _ELF_H( handle )->parallelUptr = uptr;
+  _ELF_H( handle )->grain = ( grain ? ( Elf_Size )grain : _ELF_DEFAULT_GRAIN );
+}
+
+/**
+ * Find the ELF symbol containing an address
+ * the address index is built on first use, so the first call is O(n log n)
+ * must not be called before elf_link
+ * @param  handle Valid, linked ELF context
+ * @param  addr   Address inside the linked ELF memory
+ * @param  info   Receives symbol name, start and size
+ * @return        Non-zero if a containing symbol was found
+ */
+int elf_dladdr( void * handle, const void * addr, elf_syminfo * info ) {
+  Elf_handle * const h = _ELF_H( handle );
+  const uintptr_t target = ( uintptr_t )addr;
+
+  if ( !h->linkBuf ) {
+    return 0;
+  }
+
+  if ( !h->addrIndex ) {
+    _elf_addr_build( h );
+
+    if ( !h->addrIndex ) {
+      return 0;
+    }
+  }
+
+  /* Last entry starting at or before target */
+  Elf_Size lower = 0, upper = h->addrLength;
+  while ( lower < upper ) {
+    const Elf_Size middle = lower + ( upper - lower ) / 2;
+
+    if ( h->addrIndex[middle].addr <= target ) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+
+  /* Walk back past aliases and smaller symbols (labels inside a function) to the nearest one containing target */
+  while ( lower-- > 0 && h->addrIndex[lower].reach > target ) {
+    const Elf_addrNode * const node = &h->addrIndex[lower];
+    const Elf_Sym * const symbol = &h->symtab[node->index];
+
+    if ( target < node->addr + symbol->st_size || target == node->addr ) {
+      info->sname = h->strtab + symbol->st_name;
+      info->saddr = ( void * )symbol->st_value;
+      info->ssize = symbol->st_size;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Set the cycle counter used to time imported calls
+ * without a clock, profiled imports only count calls
+ * each import times one call at a time, calls made meanwhile (nested or from other threads) are only counted
+ * counting and timing are thread safe where the compiler has lock-free word atomics, single-threaded otherwise
+ * a longjmp or exception out of a timed call skips its exit, the import stays untimed until elf_profreset
+ * @param handle Valid, open ELF context
+ * @param clock  Cycle counter, or NULL to only count calls
+ * @param uptr   Cookie user pointer to be sent to elf_clockf
+ */
+void elf_profclock( void * handle, elf_clockf clock, void * uptr ) {
+  _ELF_H( handle )->clock = clock;
+  _ELF_H( handle )->clockUptr = uptr;
+}
+
+/**
+ * Route imported calls through, or restore them from, the profiling thunks
+ * no relinking is needed, only the jump slots are rewritten
+ * must not be called while an imported call is in progress
+ * @param handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @param enable Non-zero to profile, zero to call imports directly
+ */
+void elf_profenable( void * handle, int enable ) {
+  Elf_flushRange range = { 0, 0, 0 };
+
+  for ( Elf_Size ii = 0; ii < _ELF_H( handle )->thunkLength; ii++ ) {
+    Elf_thunk * const thunk = &_ELF_H( handle )->thunks[ii];
+
+    *thunk->slot = ( Elf_Addr )( enable ? ( uintptr_t )thunk->code : thunk->target );
+    _elf_flush_add( _ELF_H( handle ), &range, ( uintptr_t )thunk->slot, sizeof( *thunk->slot ), ELF_FLUSH_DATA );
+  }
+
+  _elf_flush_end( _ELF_H( handle ), &range );
+}
+
+/**
+ * Number of profiled imports
+ * @param  handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @return        Import count, zero if not profiling
+ */
+size_t elf_profcount( void * handle ) {
+  return _ELF_H( handle )->thunkLength;
+}
+
+/**
+ * Read the statistics of one profiled import
+ * @param  handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @param  index  Import index below elf_profcount
+ * @param  info   Receives name, call count and accumulated cycles
+ * @return        Non-zero if index is valid
+ */
+int elf_profstat( void * handle, size_t index, elf_profinfo * info ) {
+  if ( index >= _ELF_H( handle )->thunkLength ) {
+    return 0;
+  }
+
+  const Elf_thunk * const thunk = &_ELF_H( handle )->thunks[index];
+
+  info->name = thunk->name;
+  info->calls = thunk->calls;
+  info->cycles = thunk->cycles;
+  return 1;
+}
+
+/**
+ * Zero the statistics of every profiled import
+ * also drops the timing claim of calls left unfinished by longjmp or exceptions
+ * must not be called while an imported call is in progress
+ * @param handle Valid ELF context linked with ELF_RTLD_PROFILE
+ */
+void elf_profreset( void * handle ) {
+  for ( Elf_Size ii = 0; ii < _ELF_H( handle )->thunkLength; ii++ ) {
+    _ELF_H( handle )->thunks[ii].calls = 0;
+    _ELF_H( handle )->thunks[ii].cycles = 0;
+    _ELF_H( handle )->thunks[ii].active = 0;
+  }
+}
+
+/**
+ * Plan a tight packing of several ELFs into one memory region
+ * each module occupies only its lowest to highest loaded address (plus profiling thunks)
+ * a module base is aligned to align or to the largest p_align of its PT_LOAD segments, whichever is larger
+ * modules linked with a large max-page-size (-z max-page-size) therefore pack at that granularity
+ * @param  modules Modules to place, offset and size are filled in
+ * @param  count   Number of modules
+ * @param  align   Power of two alignment of each module base, or zero for the default
+ * @return         Region byte length required, or zero if align is not a power of two
+ */
+size_t elf_pack( elf_packinfo * modules, size_t count, size_t align ) {
+  size_t cursor = 0;
+
+  if ( !align ) {
+    align = _ELF_PACK_ALIGN;
+  }
+
+  if ( align & ( align - 1 ) ) {
+    return 0;
+  }
+
+  for ( size_t ii = 0; ii < count; ii++ ) {
+    Elf_handle * const handle = _ELF_H( modules[ii].handle );
+    size_t low, high, moduleAlign = align;
+
+    _elf_image_extent( handle, &low, &high );
+
+    /* Segments keep the alignment they were linked for (page aligned data, TLS, vector constants) */
+    for ( Elf_Half jj = 0; jj < handle->header->e_phnum; jj++ ) {
+      const Elf_Phdr * const program = ELF_PH_GET( handle->header, jj );
+
+      if ( program->p_type == PT_LOAD && program->p_align > moduleAlign && !( program->p_align & ( program->p_align - 1 ) ) ) {
+        moduleAlign = program->p_align;
+      }
+    }
+
+    if ( handle->flags & ELF_RTLD_PROFILE ) {
+      high = _elf_thunk_offset( handle ) + _elf_thunk_count( handle ) * sizeof( Elf_thunk );
+    }
+
+    /* Link base (offset - low) must be aligned, so offset keeps the alignment phase of low */
+    cursor += ( low - cursor ) & ( moduleAlign - 1 );
+
+    modules[ii].offset = cursor;
+    modules[ii].size = high - low;
+    cursor += modules[ii].size;
+  }
+
+  return cursor;
+}
+
+/**
+ * Link every ELF of an elf_pack plan into its region
+ * stops at the first module that fails, its error is read with elf_dlerror
+ * @param  modules Modules placed by elf_pack
+ * @param  count   Number of modules
+ * @param  region  Memory of the length returned by elf_pack, aligned to align and every module p_align
+ * @return         Number of modules linked successfully
+ */
+size_t elf_packlink( elf_packinfo * modules, size_t count, void * region ) {
+  for ( size_t ii = 0; ii < count; ii++ ) {
+    Elf_handle * const handle = _ELF_H( modules[ii].handle );
+    size_t low, high;
+
+    _elf_image_extent( handle, &low, &high );
+
+    /* Module is linked as if loaded at vaddr zero, the memory below low is never touched */
+    elf_link( handle, ( void * )( ( uintptr_t )region + modules[ii].offset - low ) );
+
+    if ( handle->flags & _ELF_ERROR ) {
+      return ii;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * Set the callback told about memory modified by elf_link and later patching
+ * ranges are reported after writing and before any of the modified code can run
+ * @param handle Valid, open ELF context
+ * @param flush  Cache maintenance callback, or NULL
+ * @param uptr   Cookie user pointer to be sent to elf_flushf
+ */
+void elf_flushcb( void * handle, elf_flushf flush, void * uptr ) {
+  _ELF_H( handle )->flush = flush;
+  _ELF_H( handle )->flushUptr = uptr;
+}
+
+/**
+ * ELF pool initialization (default realloc/free)
+ * a pool recycles handles and link buffers of modules that are opened and closed repeatedly
+ * @param  cached Number of closed modules kept ready for elf_poolopen
+ * @return        Handle to ELF pool
+ */
+void * elf_poolcreate( size_t cached ) {
+  return elf_poolcreate_alloc( cached, _elf_stdalloc, NULL );
+}
+
+/**
+ * ELF pool initialization (custom allocator, see elf_allocf)
+ * @param  cached Number of closed modules kept ready for elf_poolopen
+ * @param  alloc  Realloc with a uptr cookie, used for the pool and every module it opens
+ * @param  uptr   Cookie user pointer to be sent to elf_allocf
+ * @return        Handle to ELF pool
+ */
+void * elf_poolcreate_alloc( size_t cached, elf_allocf alloc, void * uptr ) {
+  Elf_pool * const pool = ( Elf_pool * )alloc( uptr, NULL, sizeof( *pool ) );
+
+  pool->alloc = alloc;
+  pool->uptr = uptr;
+  pool->entries = NULL;
+  pool->entryLength = 0;
+  pool->entryCapacity = 0;
+  pool->cached = cached;
+  pool->clock = 0;
+
+  for ( size_t ii = 0; ii < _ELF_POOL_CLASSES; ii++ ) {
+    pool->buffers[ii] = NULL;
+  }
+
+  return pool;
+}
+
+/**
+ * Destroys an ELF pool, every module it opened and every link buffer it holds
+ * @param pool Valid ELF pool
+ */
+void elf_pooldestroy( void * pool ) {
+  while ( _ELF_POOL( pool )->entryLength ) {
+    _elf_pool_evict( _ELF_POOL( pool ), &_ELF_POOL( pool )->entries[0] );
+  }
+
+  for ( size_t ii = 0; ii < _ELF_POOL_CLASSES; ii++ ) {
+    while ( _ELF_POOL( pool )->buffers[ii] ) {
+      Elf_poolBuffer * const buffer = _ELF_POOL( pool )->buffers[ii];
+
+      _ELF_POOL( pool )->buffers[ii] = buffer->next;
+      _ELF_POOL( pool )->alloc( _ELF_POOL( pool )->uptr, buffer, 0 );
+    }
+  }
+
+  if ( _ELF_POOL( pool )->entries ) {
+    _ELF_POOL( pool )->alloc( _ELF_POOL( pool )->uptr, _ELF_POOL( pool )->entries, 0 );
+  }
+
+  _ELF_POOL( pool )->alloc( _ELF_POOL( pool )->uptr, pool, 0 );
+}
+
+/**
+ * ELF initialization through a pool
+ * a closed module of the same source and flags is reused as is, skipping header parsing
+ * reused modules keep their elf_mapsym symbols, callbacks and link buffer
+ * @param  pool Valid ELF pool
+ * @param  buf  Pointer to ELF file in memory
+ * @param  flag ELF_RTLD_* bit flags (defined above)
+ * @return      Handle to loaded ELF context, to be closed with elf_poolclose
+ */
+void * elf_poolopen( void * pool, const void * buf, int flag ) {
+  Elf_poolEntry * reuse = NULL;
+
+  for ( size_t ii = 0; ii < _ELF_POOL( pool )->entryLength; ii++ ) {
+    Elf_poolEntry * const entry = &_ELF_POOL( pool )->entries[ii];
+
+    if ( !entry->open && entry->source == buf && entry->flag == flag && ( !reuse || entry->stamp > reuse->stamp ) ) {
+      reuse = entry;
+    }
+  }
+
+  if ( reuse ) {
+    reuse->open = 1;
+    reuse->handle->flags = flag;
+    reuse->handle->link.phase = ELF_LINK_IDLE;
+    reuse->handle->link.done = 0;
+    reuse->handle->link.total = 0;
+    return reuse->handle;
+  }
+
+  Elf_handle * const handle = _ELF_H( elf_dlmemopen_alloc( buf, flag, _ELF_POOL( pool )->alloc, _ELF_POOL( pool )->uptr ) );
+
+  /* Modules that fail to open are not pooled, elf_poolclose destroys them */
+  if ( handle->flags & _ELF_ERROR ) {
+    return handle;
+  }
+
+  if ( _ELF_POOL( pool )->entryLength == _ELF_POOL( pool )->entryCapacity ) {
+    const size_t capacity = ( _ELF_POOL( pool )->entryCapacity ? _ELF_POOL( pool )->entryCapacity * 2 : 4 );
+    Elf_poolEntry * const entries = ( Elf_poolEntry * )_ELF_POOL( pool )->alloc( _ELF_POOL( pool )->uptr, _ELF_POOL( pool )->entries, sizeof( *entries ) * capacity );
+
+    /* Untracked, so it fails like a module that did not open */
+    if ( !entries ) {
+      handle->flags |= _ELF_ERROR;
+      handle->error = _elf_error_allocation;
+      return handle;
+    }
+
+    _ELF_POOL( pool )->entries = entries;
+    _ELF_POOL( pool )->entryCapacity = capacity;
+  }
+
+  Elf_poolEntry * const entry = &_ELF_POOL( pool )->entries[_ELF_POOL( pool )->entryLength++];
+
+  entry->source = buf;
+  entry->flag = flag;
+  entry->handle = handle;
+  entry->buf = NULL;
+  entry->sizeClass = 0;
+  entry->open = 1;
+  entry->stamp = 0;
+  return handle;
+}
+
+/**
+ * Link memory for a module opened with elf_poolopen
+ * reused modules get their previous link buffer back, others take one from power of two size classes
+ * @param  pool   Valid ELF pool
+ * @param  handle Valid ELF context opened by the pool
+ * @return        Memory of at least elf_lbounds bytes owned by the pool, or NULL if failed
+ */
+void * elf_poolbuf( void * pool, void * handle ) {
+  Elf_poolEntry * const entry = _elf_pool_find( _ELF_POOL( pool ), handle );
+
+  if ( !entry ) {
+    return NULL;
+  }
+
+  const int sizeClass = _elf_pool_class( elf_lbounds( handle ) );
+
+  if ( entry->buf && entry->sizeClass != sizeClass ) {
+    _elf_pool_release( _ELF_POOL( pool ), entry->buf, entry->sizeClass );
+    entry->buf = NULL;
+  }
+
+  if ( !entry->buf ) {
+    entry->buf = _elf_pool_acquire( _ELF_POOL( pool ), sizeClass );
+    entry->sizeClass = sizeClass;
+  }
+
+  return entry->buf;
+}
+
+/**
+ * Unlinks an ELF context opened with elf_poolopen, instead of elf_dlclose
+ * the module is kept for reuse, the least recently closed modules beyond the cache are destroyed
+ * @param pool   Valid ELF pool
+ * @param handle Valid ELF context opened by the pool
+ */
+void elf_poolclose( void * pool, void * handle ) {
+  Elf_poolEntry * const entry = _elf_pool_find( _ELF_POOL( pool ), handle );
+  size_t closed = 0;
+
+  if ( !entry ) {
+    elf_dlclose( handle );
+    return;
+  }
+
+  _elf_fini( _ELF_H( handle ) );
+  entry->open = 0;
+  entry->stamp = ++_ELF_POOL( pool )->clock;
+
+  for ( size_t ii = 0; ii < _ELF_POOL( pool )->entryLength; ii++ ) {
+    closed += !_ELF_POOL( pool )->entries[ii].open;
+  }
+
+  while ( closed > _ELF_POOL( pool )->cached ) {
+    Elf_poolEntry * oldest = NULL;
+
+    for ( size_t ii = 0; ii < _ELF_POOL( pool )->entryLength; ii++ ) {
+      Elf_poolEntry * const candidate = &_ELF_POOL( pool )->entries[ii];
+
+      if ( !candidate->open && ( !oldest || candidate->stamp < oldest->stamp ) ) {
+        oldest = candidate;
+      }
+    }
+
+    _elf_pool_evict( _ELF_POOL( pool ), oldest );
+    closed--;
+  }
+}
+
+/**
+ * Point every relocation slot of an imported symbol at a new definition
+ * each slot is patched with a single word store, calls in flight see the old or the new target
+ * profiled jump slots keep their thunk, the thunk is retargeted instead
+ * @param  handle Valid ELF context linked with ELF_RTLD_REBIND
+ * @param  name   Cstring name of the imported symbol
+ * @param  sym    Pointer to the new symbol data, also replaces the elf_mapsym entry
+ * @return        Non-zero if the module imports name
+ */
+int elf_rebind( void * handle, const char * name, void * sym ) {
+  Elf_handle * const h = _ELF_H( handle );
+  const int hash = _elf_hash( name );
+  Elf_flushRange range = { 0, 0, 0 };
+  int found = 0;
+
+  /* First slot with a matching hash */
+  Elf_Size lower = 0, upper = h->rebindLength;
+  while ( lower < upper ) {
+    const Elf_Size middle = lower + ( upper - lower ) / 2;
+
+    if ( h->rebinds[middle].hash < hash ) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+
+  /* Slots of one symbol are contiguous, different names may share a hash */
+  while ( lower < h->rebindLength && h->rebinds[lower].hash == hash ) {
+    Elf_Sym * const symbol = &h->symtab[h->rebinds[lower].symbol];
+    const Elf_Addr delta = ( Elf_Addr )( uintptr_t )sym - symbol->st_value;
+    const int match = !strcmp( h->strtab + symbol->st_name, name );
+
+    for ( ; lower < h->rebindLength && &h->symtab[h->rebinds[lower].symbol] == symbol; lower++ ) {
+      const Elf_rebindSlot * const record = &h->rebinds[lower];
+
+      if ( !match ) {
+        continue;
+      }
+
+      if ( record->thunk ) {
+        record->thunk->target += delta;
+        _elf_flush_add( h, &range, ( uintptr_t )&record->thunk->target, sizeof( record->thunk->target ), ELF_FLUSH_DATA );
+
+        /* Profiling, the slot keeps pointing at the thunk */
+        if ( *record->slot == ( Elf_Addr )( uintptr_t )record->thunk->code ) {
+          continue;
+        }
+      }
+
+      *( volatile Elf_Addr * )record->slot = *record->slot + delta;
+      _elf_flush_add( h, &range, ( uintptr_t )record->slot, sizeof( *record->slot ), ELF_FLUSH_DATA );
+    }
+
+    if ( match ) {
+      symbol->st_value = ( Elf_Addr )( uintptr_t )sym;
+      found = 1;
+    }
+  }
+
+  _elf_flush_end( h, &range );
+
+  if ( found ) {
+    _elf_tree_add( h, hash, sym );
+  }
+
+  return found;
+}
+
+/**
+ * Visit every symbol the ELF imports (undefined in the ELF, to be added by elf_mapsym)
+ * reads the source file directly, or the tables an ELF_RTLD_LZ4 source keeps decompressed
+ * so it may be called any time after opening
+ * @param  handle Valid, open ELF context
+ * @param  visit  Called once per import in symbol table order, or NULL to only count
+ * @param  uptr   Cookie user pointer to be sent to elf_importf
+ * @return        Number of imports, zero with an LZ4 error if an ELF_RTLD_LZ4 source lacks the tables
+ */
+size_t elf_imports( void * handle, elf_importf visit, void * uptr ) {
+  Elf_handle * const h = _ELF_H( handle );
+  const Elf_Dyn * dynamicEntries;
+  const Elf32_Word * hash = NULL;
+  const Elf_Sym * symtab = NULL;
+  const char * strtab = NULL;
+  size_t count = 0;
+
+  if ( !h->header ) {
+    return 0;
+  }
+
+  dynamicEntries = _elf_source_dynamic( h );
+
+  for ( const Elf_Dyn * dynamics = dynamicEntries; dynamics && dynamics->d_tag != DT_NULL; dynamics++ ) {
+    switch ( dynamics->d_tag ) {
+    case DT_HASH:
+      hash = ( const Elf32_Word * )_elf_source_table( h, dynamics->d_un.d_ptr );
+      break;
+    case DT_SYMTAB:
+      symtab = ( const Elf_Sym * )_elf_source_table( h, dynamics->d_un.d_ptr );
+      break;
+    case DT_STRTAB:
+      strtab = ( const char * )_elf_source_table( h, dynamics->d_un.d_ptr );
+      break;
+    }
+  }
+
+  if ( !hash || !symtab || !strtab ) {
+    if ( h->flags & ELF_RTLD_LZ4 ) {
+      h->flags |= _ELF_ERROR;
+      h->error = _elf_error_lz4;
+    }
+
+    return 0;
+  }
+
+  for ( Elf_Size ii = 1; ii < hash[1]; ii++ ) {
+    const Elf_Sym * const symbol = &symtab[ii];
+
+    if ( symbol->st_shndx != SHN_UNDEF ) {
+      continue;
+    }
+
+    if ( visit ) {
+      elf_importinfo info;
+
+      info.name = strtab + symbol->st_name;
+      info.weak = ( ( ELF_ST_BIND( symbol->st_info ) & STB_WEAK ) != 0 );
+      info.hash = _elf_hash( info.name );
+      visit( uptr, &info );
+    }
+
+    count++;
+  }
+
+  return count;
+}
+
+/**
+ * Hash used by the link map, elf_importinfo carries the hash of each import
+ * allows a host export table to be indexed with the same keys
+ * @param  name Cstring symbol name
+ * @return      Hash value
+ */
+int elf_hash( const char * name ) {
+  return _elf_hash( name );
 }
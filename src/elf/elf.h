@@ -2,7 +2,7 @@
 
   elf.h
 
-  Embedded ARM ELF32 loader
+  Embedded ARM ELF32 / AArch64 ELF64 loader
 
 */
 
@@ -10,12 +10,42 @@
 #define __ELF_H__
 
 #include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t uint64_t */
 
 /**
  * elf_dl*open flag parameters
  */
 #define ELF_RTLD_DEFAULT    ( 0x0 )
 #define ELF_RTLD_SKIP_CHECK ( 0x1 )
+#define ELF_RTLD_PROFILE    ( 0x2 ) /* Route imported calls through counting thunks (ARM state) */
+#define ELF_RTLD_LZ4        ( 0x4 ) /* Source is an LZ4 frame of the ELF file, must stay valid until elf_link, tables are decoded on open */
+#define ELF_RTLD_REBIND     ( 0x8 ) /* Record the relocation slots of every import for elf_rebind */
+
+/**
+ * elf_flushf range tags
+ */
+#define ELF_FLUSH_DATA ( 0x0 ) /* Data only, D-cache clean is enough */
+#define ELF_FLUSH_EXEC ( 0x1 ) /* Executable, I-cache must be invalidated too */
+
+/**
+ * Phases of an elf_link_step link, returned by elf_link_progress
+ */
+#define ELF_LINK_IDLE     ( 0 ) /* No link in progress (or the last one failed) */
+#define ELF_LINK_COPY     ( 1 ) /* Copying segments, units are bytes */
+#define ELF_LINK_RESOLVE  ( 2 ) /* Resolving symbols, units are symbols */
+#define ELF_LINK_RELOCATE ( 3 ) /* Applying relocations, units are relocations */
+#define ELF_LINK_INIT     ( 4 ) /* Running constructors, units are constructors */
+#define ELF_LINK_DONE     ( 5 ) /* Linked */
+
+/**
+ * Type used for cache maintenance callbacks if desired
+ * called with coalesced ranges of memory the loader has modified
+ * @param void * Cookie pointer provided by elf_flushcb caller
+ * @param void * Start of modified memory
+ * @param size_t Byte length of modified memory
+ * @param int    ELF_FLUSH_* tag (defined above)
+ */
+typedef void ( * elf_flushf )( void *, void *, size_t, int );
 
 /**
  * Type used for custom allocators if desired
@@ -27,6 +57,75 @@
  */
 typedef void * ( * elf_allocf )( void *, void *, size_t );
 
+/**
+ * Unit of work handed to an elf_parallelf
+ * @param void * Context pointer provided by elf_parallelf caller
+ * @param size_t Index of the task in [0, count)
+ */
+typedef void ( * elf_taskf )( void *, size_t );
+
+/**
+ * Type used for custom parallel-for dispatchers if desired
+ * must call the task once for every index in [0, count), on any thread and in any order
+ * and only return once every task has completed
+ * @param void *    Cookie pointer provided by elf_parallel caller
+ * @param elf_taskf Task to run for each index
+ * @param void *    Context pointer to be sent to elf_taskf
+ * @param size_t    Number of tasks (count)
+ */
+typedef void ( * elf_parallelf )( void *, elf_taskf, void *, size_t );
+
+/**
+ * Symbol description filled by elf_dladdr
+ */
+typedef struct {
+  const char * sname; /* Symbol name, valid while the link memory is */
+  void *       saddr; /* Symbol value (Thumb functions keep bit 0 set) */
+  size_t       ssize; /* Symbol size in bytes */
+} elf_syminfo;
+
+/**
+ * Type used for the profiling cycle counter
+ * only differences are used, so the counter may wrap
+ * @param  void * Cookie pointer provided by elf_profclock caller
+ * @return        Current cycle count
+ */
+typedef uint32_t ( * elf_clockf )( void * );
+
+/**
+ * Imported call statistics filled by elf_profstat
+ */
+typedef struct {
+  const char * name;   /* Imported symbol name, valid while the link memory is */
+  uint32_t     calls;  /* Calls made through the jump slot */
+  uint64_t     cycles; /* Cycles spent in timed calls */
+} elf_profinfo;
+
+/**
+ * Import description passed to elf_importf
+ */
+typedef struct {
+  const char * name; /* Imported symbol name, valid while the ELF source is */
+  int          weak; /* Non-zero for weak imports, elf_link leaves those NULL if unmapped */
+  int          hash; /* Link map hash of name, see elf_hash */
+} elf_importinfo;
+
+/**
+ * Type used for visiting the imports of an ELF
+ * @param void *                 Cookie pointer provided by elf_imports caller
+ * @param const elf_importinfo * Import description, only valid during the call
+ */
+typedef void ( * elf_importf )( void *, const elf_importinfo * );
+
+/**
+ * Module placement used by elf_pack and elf_packlink
+ */
+typedef struct {
+  void * handle; /* Valid, open ELF context to place */
+  size_t offset; /* Byte offset of the module within the region (set by elf_pack) */
+  size_t size;   /* Bytes used by the module from offset (set by elf_pack) */
+} elf_packinfo;
+
 #if defined( __cplusplus )
 extern "C" {
 #endif
@@ -89,6 +188,29 @@ size_t elf_lbounds( void * handle );
  */
 void elf_link( void * handle, void * buf );
 
+/**
+ * Link ELF into given memory buffer, a limited amount of work at a time
+ * the first call starts the link, following calls continue it until done
+ * once linked, calls do no work and return zero (elf_link links again)
+ * with elf_parallel set, resolution and relocation complete within a single step
+ * the step applying the last relocation also does work outside the budget: it builds the profiling thunks
+ * (one per jump slot), sorts the elf_rebind records (n log n in the import relocations) and reports elf_flushf ranges
+ * @param  handle Valid, open ELF context
+ * @param  buf    Allocated memory of size given by elf_lbounds, the same for every step of a link
+ * @param  budget Units of work allowed (bytes copied or decompressed and placed, symbols resolved, relocations applied, constructors run)
+ * @return        Non-zero while the link is unfinished, zero once linked or on error (see elf_dlerror)
+ */
+int elf_link_step( void * handle, void * buf, size_t budget );
+
+/**
+ * Progress of the current elf_link_step link
+ * @param  handle Valid, open ELF context
+ * @param  done   Receives units of work done in the current phase
+ * @param  total  Receives units of work in the current phase
+ * @return        ELF_LINK_* phase (defined above)
+ */
+int elf_link_progress( void * handle, size_t * done, size_t * total );
+
 /**
  * Find ELF symbol
  * used to locate ELF symbols such as function pointers
@@ -99,6 +221,188 @@ void elf_link( void * handle, void * buf );
  */
 void * elf_dlsym( void * handle, const char * symbol );
 
+/**
+ * Set a parallel-for dispatcher used by elf_link
+ * symbol resolution and relocation tables are split into chunks of grain entries
+ * every export of the module is mapped before its imports resolve
+ * @param handle   Valid, open ELF context
+ * @param parallel Dispatcher, or NULL to link serially
+ * @param uptr     Cookie user pointer to be sent to elf_parallelf
+ * @param grain    Table entries per task, or zero for the default
+ */
+void elf_parallel( void * handle, elf_parallelf parallel, void * uptr, size_t grain );
+
+/**
+ * Find the ELF symbol containing an address
+ * used to symbolize program counters inside a linked ELF
+ * the nearest symbol starting at or before addr whose range contains it wins
+ * zero sized symbols (labels) only match their own address
+ * must not be called before elf_link
+ * @param  handle Valid, linked ELF context
+ * @param  addr   Address inside the loaded segments of the ELF
+ * @param  info   Receives symbol name, start and size
+ * @return        Non-zero if a containing symbol was found
+ */
+int elf_dladdr( void * handle, const void * addr, elf_syminfo * info );
+
+/**
+ * Set the cycle counter used to time imported calls
+ * without a clock, profiled imports only count calls
+ * each import times one call at a time, calls made meanwhile (nested or from other threads) are only counted
+ * counting and timing are thread safe where the compiler has lock-free word atomics, single-threaded otherwise
+ * a longjmp or exception out of a timed call skips its exit, the import stays untimed until elf_profreset
+ * @param handle Valid, open ELF context
+ * @param clock  Cycle counter, or NULL to only count calls
+ * @param uptr   Cookie user pointer to be sent to elf_clockf
+ */
+void elf_profclock( void * handle, elf_clockf clock, void * uptr );
+
+/**
+ * Route imported calls through, or restore them from, the profiling thunks
+ * no relinking is needed, only the jump slots are rewritten
+ * must not be called while an imported call is in progress
+ * @param handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @param enable Non-zero to profile, zero to call imports directly
+ */
+void elf_profenable( void * handle, int enable );
+
+/**
+ * Number of profiled imports
+ * @param  handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @return        Import count, zero if not profiling
+ */
+size_t elf_profcount( void * handle );
+
+/**
+ * Read the statistics of one profiled import
+ * @param  handle Valid ELF context linked with ELF_RTLD_PROFILE
+ * @param  index  Import index below elf_profcount
+ * @param  info   Receives name, call count and accumulated cycles
+ * @return        Non-zero if index is valid
+ */
+int elf_profstat( void * handle, size_t index, elf_profinfo * info );
+
+/**
+ * Zero the statistics of every profiled import
+ * also drops the timing claim of calls left unfinished by longjmp or exceptions
+ * must not be called while an imported call is in progress
+ * @param handle Valid ELF context linked with ELF_RTLD_PROFILE
+ */
+void elf_profreset( void * handle );
+
+/**
+ * Plan a tight packing of several ELFs into one memory region
+ * each module occupies only its lowest to highest loaded address (plus profiling thunks)
+ * a module base is aligned to align or to the largest p_align of its PT_LOAD segments, whichever is larger
+ * modules linked with a large max-page-size (-z max-page-size) therefore pack at that granularity
+ * @param  modules Modules to place, offset and size are filled in
+ * @param  count   Number of modules
+ * @param  align   Power of two alignment of each module base, or zero for the default
+ * @return         Region byte length required, or zero if align is not a power of two
+ */
+size_t elf_pack( elf_packinfo * modules, size_t count, size_t align );
+
+/**
+ * Link every ELF of an elf_pack plan into its region
+ * stops at the first module that fails, its error is read with elf_dlerror
+ * @param  modules Modules placed by elf_pack
+ * @param  count   Number of modules
+ * @param  region  Memory of the length returned by elf_pack, aligned to align and every module p_align
+ * @return         Number of modules linked successfully
+ */
+size_t elf_packlink( elf_packinfo * modules, size_t count, void * region );
+
+/**
+ * Set the callback told about memory modified by elf_link and later patching
+ * ranges are reported after writing and before any of the modified code can run
+ * @param handle Valid, open ELF context
+ * @param flush  Cache maintenance callback, or NULL
+ * @param uptr   Cookie user pointer to be sent to elf_flushf
+ */
+void elf_flushcb( void * handle, elf_flushf flush, void * uptr );
+
+/**
+ * Point every relocation slot of an imported symbol at a new definition
+ * each slot is patched with a single word store, calls in flight see the old or the new target
+ * profiled jump slots keep their thunk, the thunk is retargeted instead
+ * @param  handle Valid ELF context linked with ELF_RTLD_REBIND
+ * @param  name   Cstring name of the imported symbol
+ * @param  sym    Pointer to the new symbol data, also replaces the elf_mapsym entry
+ * @return        Non-zero if the module imports name
+ */
+int elf_rebind( void * handle, const char * name, void * sym );
+
+/**
+ * Visit every symbol the ELF imports (undefined in the ELF, to be added by elf_mapsym)
+ * reads the source file directly, or the tables an ELF_RTLD_LZ4 source keeps decompressed
+ * so it may be called any time after opening
+ * @param  handle Valid, open ELF context
+ * @param  visit  Called once per import in symbol table order, or NULL to only count
+ * @param  uptr   Cookie user pointer to be sent to elf_importf
+ * @return        Number of imports, zero with an LZ4 error if an ELF_RTLD_LZ4 source lacks the tables
+ */
+size_t elf_imports( void * handle, elf_importf visit, void * uptr );
+
+/**
+ * Hash used by the link map, elf_importinfo carries the hash of each import
+ * allows a host export table to be indexed with the same keys
+ * @param  name Cstring symbol name
+ * @return      Hash value
+ */
+int elf_hash( const char * name );
+
+/**
+ * ELF pool initialization (default realloc/free)
+ * a pool recycles handles and link buffers of modules that are opened and closed repeatedly
+ * @param  cached Number of closed modules kept ready for elf_poolopen
+ * @return        Handle to ELF pool
+ */
+void * elf_poolcreate( size_t cached );
+
+/**
+ * ELF pool initialization (custom allocator, see elf_allocf)
+ * @param  cached Number of closed modules kept ready for elf_poolopen
+ * @param  alloc  Realloc with a uptr cookie, used for the pool and every module it opens
+ * @param  uptr   Cookie user pointer to be sent to elf_allocf
+ * @return        Handle to ELF pool
+ */
+void * elf_poolcreate_alloc( size_t cached, elf_allocf alloc, void * uptr );
+
+/**
+ * Destroys an ELF pool, every module it opened and every link buffer it holds
+ * @param pool Valid ELF pool
+ */
+void elf_pooldestroy( void * pool );
+
+/**
+ * ELF initialization through a pool
+ * a closed module of the same source and flags is reused as is, skipping header parsing
+ * reused modules keep their elf_mapsym symbols, callbacks and link buffer
+ * modules that fail to open, or that the pool cannot track, carry an elf_dlerror and are not pooled
+ * @param  pool Valid ELF pool
+ * @param  buf  Pointer to ELF file in memory
+ * @param  flag ELF_RTLD_* bit flags (defined above)
+ * @return      Handle to loaded ELF context, to be closed with elf_poolclose
+ */
+void * elf_poolopen( void * pool, const void * buf, int flag );
+
+/**
+ * Link memory for a module opened with elf_poolopen
+ * reused modules get their previous link buffer back, others take one from power of two size classes
+ * @param  pool   Valid ELF pool
+ * @param  handle Valid ELF context opened by the pool
+ * @return        Memory of at least elf_lbounds bytes owned by the pool, or NULL if failed
+ */
+void * elf_poolbuf( void * pool, void * handle );
+
+/**
+ * Unlinks an ELF context opened with elf_poolopen, instead of elf_dlclose
+ * the module is kept for reuse, the least recently closed modules beyond the cache are destroyed
+ * @param pool   Valid ELF pool
+ * @param handle Valid ELF context opened by the pool
+ */
+void elf_poolclose( void * pool, void * handle );
+
 #if defined( __cplusplus )
 }
 #endif
@@ -0,0 +1,40 @@
+/*
+
+  benchobject.c
+
+  Module loaded by elfbench, build one per call style (the elfbench Makefile does the same):
+    arm-linux-gnueabihf-gcc -O2 -marm                -shared -fPIC -nostdlib -Wl,--hash-style=sysv benchobject.c -o bench_arm.so
+    arm-linux-gnueabihf-gcc -O2 -marm -mlong-calls   -shared -fPIC -nostdlib -Wl,--hash-style=sysv benchobject.c -o bench_arm_long.so
+    arm-linux-gnueabihf-gcc -O2 -marm -fno-plt       -shared -fPIC -nostdlib -Wl,--hash-style=sysv benchobject.c -o bench_arm_noplt.so
+    arm-linux-gnueabihf-gcc -O2 -mthumb              -shared -fPIC -nostdlib -Wl,--hash-style=sysv benchobject.c -o bench_thumb.so
+    arm-linux-gnueabihf-gcc -O2 -mthumb -mlong-calls -shared -fPIC -nostdlib -Wl,--hash-style=sysv benchobject.c -o bench_thumb_long.so
+
+  -nostdlib keeps DT_NEEDED out, --hash-style=sysv provides the DT_HASH table the loader reads
+
+*/
+
+/* Provided by elfbench */
+extern void host_nop( void );
+
+static void __attribute__ ((noinline)) local_nop( void ) {
+  __asm__ volatile ( "" );
+}
+
+/* Called by elfbench, measures a call into the module */
+__attribute__ ((visibility("default"))) void bench_nop( void ) {
+  __asm__ volatile ( "" );
+}
+
+/* Measures a call out of the module, through the import */
+__attribute__ ((visibility("default"))) void bench_import( unsigned int count ) {
+  while ( count-- ) {
+    host_nop();
+  }
+}
+
+/* Same loop with a call that never leaves the module, the baseline of bench_import */
+__attribute__ ((visibility("default"))) void bench_local( unsigned int count ) {
+  while ( count-- ) {
+    local_nop();
+  }
+}
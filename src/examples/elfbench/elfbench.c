@@ -0,0 +1,272 @@
+/*
+
+  elfbench.c
+
+  Cost of calls out of (imports) and into (exports) linked modules
+  make -C src/examples/elfbench builds the modules and this program and runs it (CROSS and QEMU select the tools)
+  by hand, build for ARM Linux, then run on hardware or under qemu-arm user mode:
+    arm-linux-gnueabihf-gcc -O2 -marm -static -Isrc src/elf/elf.c src/examples/elfbench/elfbench.c -o elfbench
+    qemu-arm ./elfbench bench_arm.so bench_arm_long.so bench_arm_noplt.so bench_thumb.so bench_thumb_long.so
+
+  modules are built from benchobject/benchobject.c, one per call style
+  columns, per call:
+    local   module calling a function inside the module (baseline of the import columns)
+    import  module calling an ARM host function through its import
+    thumb   same import rebound to a Thumb host function (see "Unlinked Thumb functions" in the README)
+    wrap    same import rebound to an ARM wrapper around the Thumb host function
+    profile ARM import routed through the ELF_RTLD_PROFILE thunk
+    export  host calling a module function through elf_dlsym (compare with "host call")
+  times are CPU cycles when the perf cycle counter can be opened, nanoseconds otherwise
+  under qemu-arm the counter is usually unavailable, columns compare but absolute numbers are emulated
+
+*/
+
+#include <elf/elf.h>
+
+#include <stdint.h> /* uint64_t */
+#include <stdio.h> /* printf fopen fread */
+#include <stdlib.h> /* malloc free strtoul */
+#include <string.h> /* memset strcmp */
+#include <time.h> /* clock_gettime */
+#include <sys/mman.h> /* mmap munmap */
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/syscall.h> /* syscall */
+#include <unistd.h> /* read close */
+#endif
+
+/* Each measurement is the best of this many runs */
+#define BENCH_REPEAT ( 5 )
+
+typedef void ( * benchf )( unsigned int );
+typedef void ( * nopf )( void );
+
+static int counterFd = -1;
+
+/* Imported by the modules as "host_nop", the variants below are swapped in with elf_rebind */
+void __attribute__ ((noinline)) host_nop( void ) {
+  __asm__ volatile ( "" );
+}
+
+#if defined( __arm__ )
+static void __attribute__ ((noinline, target("thumb"))) host_nop_thumb( void ) {
+  __asm__ volatile ( "" );
+}
+
+static void __attribute__ ((noinline, target("arm"))) host_nop_wrap( void ) {
+  host_nop_thumb();
+}
+#else
+#define host_nop_thumb host_nop
+#define host_nop_wrap  host_nop
+#endif
+
+/* Opens the user space cycle counter, leaves counterFd negative if unavailable */
+static void bench_counter_open( void ) {
+#if defined( __linux__ )
+  struct perf_event_attr attr;
+  uint64_t count;
+
+  memset( &attr, 0, sizeof( attr ) );
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof( attr );
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  counterFd = ( int )syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+  if ( counterFd >= 0 && read( counterFd, &count, sizeof( count ) ) != sizeof( count ) ) {
+    close( counterFd );
+    counterFd = -1;
+  }
+#endif
+}
+
+/* Cycles, or nanoseconds without a cycle counter */
+static uint64_t bench_now( void ) {
+#if defined( __linux__ )
+  if ( counterFd >= 0 ) {
+    uint64_t count;
+
+    if ( read( counterFd, &count, sizeof( count ) ) == sizeof( count ) ) {
+      return count;
+    }
+  }
+#endif
+
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( uint64_t )now.tv_sec * 1000000000u + ( uint64_t )now.tv_nsec;
+}
+
+/* Time per call of a module loop making count calls */
+static double bench_module( benchf bench, unsigned int count ) {
+  uint64_t best = UINT64_MAX;
+
+  for ( int ii = 0; ii < BENCH_REPEAT; ii++ ) {
+    const uint64_t start = bench_now();
+
+    ( *bench )( count );
+
+    const uint64_t time = bench_now() - start;
+    if ( time < best ) {
+      best = time;
+    }
+  }
+
+  return ( double )best / count;
+}
+
+/* Time per call of a host loop calling target, the volatile pointer keeps the call from being inlined */
+static double bench_calls( nopf target, unsigned int count ) {
+  nopf volatile call = target;
+  uint64_t best = UINT64_MAX;
+
+  for ( int ii = 0; ii < BENCH_REPEAT; ii++ ) {
+    const uint64_t start = bench_now();
+
+    for ( unsigned int jj = 0; jj < count; jj++ ) {
+      ( *call )();
+    }
+
+    const uint64_t time = bench_now() - start;
+    if ( time < best ) {
+      best = time;
+    }
+  }
+
+  return ( double )best / count;
+}
+
+/* Linked code must reach instruction fetch before it runs */
+static void bench_flush( void * uptr, void * addr, size_t size, int flags ) {
+  if ( flags & ELF_FLUSH_EXEC ) {
+    __builtin___clear_cache( ( char * )addr, ( char * )addr + size );
+  }
+}
+
+static void * bench_read( const char * path ) {
+  FILE * const file = fopen( path, "rb" );
+  void * data = NULL;
+  long length;
+
+  if ( !file ) {
+    return NULL;
+  }
+
+  if ( fseek( file, 0, SEEK_END ) == 0 && ( length = ftell( file ) ) > 0 && fseek( file, 0, SEEK_SET ) == 0 ) {
+    data = malloc( ( size_t )length );
+
+    if ( data && fread( data, 1, ( size_t )length, file ) != ( size_t )length ) {
+      free( data );
+      data = NULL;
+    }
+  }
+
+  fclose( file );
+  return data;
+}
+
+static void bench_file( const char * path, unsigned int count ) {
+  void * const file = bench_read( path );
+  void * handle = NULL;
+  void * linkMemory = MAP_FAILED;
+  size_t size = 0;
+  const char * error;
+
+  if ( !file ) {
+    printf( "%-20s cannot read\n", path );
+    return;
+  }
+
+  /* Profiling thunks are only built for ARM modules, elsewhere the profile column matches import */
+  handle = elf_dlmemopen( file, ELF_RTLD_REBIND | ELF_RTLD_PROFILE );
+  error = elf_dlerror( handle );
+  if ( error ) {
+    printf( "%-20s ELF error \"%s\"\n", path, error );
+    goto _exit;
+  }
+
+  elf_mapsym( handle, "host_nop", ( void * )host_nop );
+  elf_flushcb( handle, bench_flush, NULL );
+
+  size = elf_lbounds( handle );
+  linkMemory = mmap( NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( linkMemory == MAP_FAILED ) {
+    printf( "%-20s cannot map %zu bytes\n", path, size );
+    goto _exit;
+  }
+
+  elf_link( handle, linkMemory );
+  error = elf_dlerror( handle );
+  if ( error ) {
+    printf( "%-20s ELF error \"%s\"\n", path, error );
+    goto _exit;
+  }
+
+  /* Linking routes imports through the thunks, call them directly unless measuring the thunks */
+  elf_profenable( handle, 0 );
+
+  const benchf local = ( benchf )elf_dlsym( handle, "bench_local" );
+  const benchf import = ( benchf )elf_dlsym( handle, "bench_import" );
+  const nopf nop = ( nopf )elf_dlsym( handle, "bench_nop" );
+  if ( !local || !import || !nop ) {
+    printf( "%-20s missing bench_local, bench_import or bench_nop\n", path );
+    goto _exit;
+  }
+
+  const double localTime = bench_module( local, count );
+  const double importTime = bench_module( import, count );
+
+  elf_rebind( handle, "host_nop", ( void * )host_nop_thumb );
+  const double thumbTime = bench_module( import, count );
+
+  elf_rebind( handle, "host_nop", ( void * )host_nop_wrap );
+  const double wrapTime = bench_module( import, count );
+
+  elf_rebind( handle, "host_nop", ( void * )host_nop );
+  elf_profenable( handle, 1 );
+  const double profileTime = bench_module( import, count );
+  elf_profenable( handle, 0 );
+
+  const double exportTime = bench_calls( nop, count );
+
+  printf( "%-20s %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", path, localTime, importTime, thumbTime, wrapTime, profileTime, exportTime );
+
+_exit:
+  /* Destructors live in the link memory, close before unmapping */
+  elf_dlclose( handle );
+  if ( linkMemory != MAP_FAILED ) {
+    munmap( linkMemory, size );
+  }
+  free( file );
+}
+
+int main( int argc, char * argv[] ) {
+  unsigned int count = 1000000;
+  int first = 1;
+
+  if ( argc > 2 && !strcmp( argv[1], "-n" ) ) {
+    count = ( unsigned int )strtoul( argv[2], NULL, 0 );
+    first = 3;
+  }
+
+  if ( first >= argc || !count ) {
+    printf( "usage: %s [-n calls] module.so...\n", argv[0] );
+    return 1;
+  }
+
+  bench_counter_open();
+
+  printf( "%u calls per run, best of %d runs, %s per call\n", count, BENCH_REPEAT, ( counterFd >= 0 ? "cycles" : "ns" ) );
+  printf( "host call %.2f\n", bench_calls( host_nop, count ) );
+  printf( "%-20s %8s %8s %8s %8s %8s %8s\n", "module", "local", "import", "thumb", "wrap", "profile", "export" );
+
+  for ( int ii = first; ii < argc; ii++ ) {
+    bench_file( argv[ii], count );
+  }
+
+  return 0;
+}
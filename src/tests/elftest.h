@@ -0,0 +1,217 @@
+/*
+
+  elftest.h
+
+  Shared pieces of the host tests
+  tests include elf/elf.c before this header, so the loader internals and ELF types are visible
+  the loader is built for the ARM target (ELF32) unless ELF_TARGET_AARCH64 is defined (ELF64)
+  ARM link memory must be addressable with 32 bits
+
+*/
+
+#include <stdio.h> /* printf */
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memset */
+
+#if defined( __linux__ )
+#include <sys/mman.h> /* mmap */
+#endif
+
+static int testFailures = 0;
+
+#define TEST_CHECK( condition ) \
+  do { \
+    if ( !( condition ) ) { \
+      printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+      testFailures++; \
+    } \
+  } while ( 0 )
+
+/**
+ * Synthetic module layout, offsets equal addresses
+ *   0x0000 - 0x1000 RX  headers, dynamic section and tables
+ *   0x1000 - 0x1200 RW  jump slots and data words, ends where the next segment starts
+ *   0x1200 - 0x1300 RW  data words, half of it bss
+ * imports host_a and host_b through jump slots, host_a also through an ABS word and host_b through a GLOB_DAT word
+ * exports module_data and module_label, a zero sized label inside module_data
+ * data words are Elf_Addr sized, so their addresses depend on the target
+ */
+#define TEST_DYNAMIC     ( 0x200 )
+#define TEST_HASH        ( 0x300 )
+#define TEST_SYMTAB      ( 0x340 )
+#define TEST_STRTAB      ( 0x400 )
+#define TEST_RELTAB      ( 0x480 )
+#define TEST_JMPRELTAB   ( 0x500 )
+#define TEST_JUMP_A      ( 0x1000 )                            /* Jump slot of host_a */
+#define TEST_JUMP_B      ( 0x1000 + sizeof( Elf_Addr ) )       /* Jump slot of host_b */
+#define TEST_ABS_A       ( 0x1100 )                            /* ABS word of host_a, plus TEST_ADDEND */
+#define TEST_RELATIVE    ( 0x1100 + sizeof( Elf_Addr ) )       /* RELATIVE word, module_data */
+#define TEST_GLOB_B      ( 0x1100 + 2 * sizeof( Elf_Addr ) )   /* GLOB_DAT word of host_b */
+#define TEST_DATA        ( 0x1200 )                            /* module_data */
+#define TEST_LABEL       ( 0x1202 )                            /* module_label */
+#define TEST_FILE_LENGTH ( 0x1280 )
+#define TEST_IMAGE_END   ( 0x1300 )
+#define TEST_ADDEND      ( 8 )
+
+#if defined( ELF_TARGET_AARCH64 )
+#define TEST_R_INFO( symbol, type ) ( ( ( Elf_Size )( symbol ) << 32 ) | ( type ) )
+#define TEST_R_ABS      R_AARCH64_ABS64
+#define TEST_R_GLOB_DAT R_AARCH64_GLOB_DAT
+#define TEST_R_RELATIVE R_AARCH64_RELATIVE
+#else
+#define TEST_R_INFO( symbol, type ) ( ( ( Elf_Size )( symbol ) << 8 ) | ( type ) )
+#define TEST_R_ABS      R_ARM_ABS32
+#define TEST_R_GLOB_DAT R_ARM_GLOB_DAT
+#define TEST_R_RELATIVE R_ARM_RELATIVE
+#endif
+
+static const char testStrtab[] = "\0host_a\0host_b\0module_data\0module_label";
+
+/**
+ * Sets a relocation, the addend goes into the entry (RELA) or the relocated word (REL)
+ * @param file   Module file
+ * @param rel    Relocation entry to fill
+ * @param offset Relocated address
+ * @param info   TEST_R_INFO of the relocation
+ * @param addend Addend
+ */
+static void test_rel( uint8_t * file, Elf_Rel * rel, Elf_Addr offset, Elf_Size info, Elf_Addr addend ) {
+  rel->r_offset = offset;
+  rel->r_info = info;
+#if defined( ELF_TARGET_AARCH64 )
+  rel->r_addend = addend;
+#else
+  *( Elf_Addr * )( file + offset ) = addend;
+#endif
+}
+
+/**
+ * Builds the synthetic module
+ * @return Module file, static storage
+ */
+static const void * test_module( void ) {
+  static uint64_t storage[TEST_FILE_LENGTH / sizeof( uint64_t )];
+  uint8_t * const file = ( uint8_t * )storage;
+  Elf_Ehdr * const header = ( Elf_Ehdr * )file;
+  Elf_Phdr * const ph = ( Elf_Phdr * )( file + sizeof( Elf_Ehdr ) );
+  Elf_Dyn * dynamics = ( Elf_Dyn * )( file + TEST_DYNAMIC );
+  Elf32_Word * const hash = ( Elf32_Word * )( file + TEST_HASH );
+  Elf_Sym * const symtab = ( Elf_Sym * )( file + TEST_SYMTAB );
+  Elf_Rel * const reltab = ( Elf_Rel * )( file + TEST_RELTAB );
+  Elf_Rel * const jmpReltab = ( Elf_Rel * )( file + TEST_JMPRELTAB );
+
+  memset( file, 0, TEST_FILE_LENGTH );
+
+  memcpy( header->e_ident, "\177ELF", 4 );
+  header->e_ident[EI_CLASS] = ELF_CLASS;
+  header->e_ident[EI_DATA] = ELFDATA2LSB;
+  header->e_ident[EI_VERSION] = 1;
+  header->e_type = ET_DYN;
+  header->e_machine = ELF_MACHINE;
+  header->e_version = 1;
+  header->e_phoff = sizeof( Elf_Ehdr );
+  header->e_phentsize = sizeof( Elf_Phdr );
+  header->e_phnum = 4;
+  header->e_ehsize = sizeof( Elf_Ehdr );
+
+  ph[0].p_type = PT_LOAD;
+  ph[0].p_offset = ph[0].p_vaddr = 0;
+  ph[0].p_filesz = ph[0].p_memsz = 0x1000;
+  ph[0].p_align = 0x100;
+  ph[0].p_flags = PF_X | 0x4; /* R X */
+
+  ph[1].p_type = PT_LOAD;
+  ph[1].p_offset = ph[1].p_vaddr = 0x1000;
+  ph[1].p_filesz = ph[1].p_memsz = 0x200;
+  ph[1].p_align = 0x100;
+  ph[1].p_flags = 0x6; /* RW */
+
+  ph[2].p_type = PT_LOAD;
+  ph[2].p_offset = ph[2].p_vaddr = 0x1200;
+  ph[2].p_filesz = TEST_FILE_LENGTH - 0x1200;
+  ph[2].p_memsz = TEST_IMAGE_END - 0x1200;
+  ph[2].p_align = 0x100;
+  ph[2].p_flags = 0x6; /* RW */
+
+  ph[3].p_type = PT_DYNAMIC;
+  ph[3].p_offset = ph[3].p_vaddr = TEST_DYNAMIC;
+  ph[3].p_filesz = ph[3].p_memsz = 16 * sizeof( Elf_Dyn );
+  ph[3].p_flags = 0x4; /* R */
+
+  hash[0] = 1; /* nbucket */
+  hash[1] = 5; /* nchain, the symbol count */
+
+  symtab[1].st_name = 1;
+  symtab[1].st_info = ( STB_GLOBAL << 4 ) | STT_FUNC;
+  symtab[2].st_name = 8;
+  symtab[2].st_info = ( STB_GLOBAL << 4 ) | STT_FUNC;
+  symtab[3].st_name = 15;
+  symtab[3].st_info = ( STB_GLOBAL << 4 ) | STT_OBJECT;
+  symtab[3].st_value = TEST_DATA;
+  symtab[3].st_size = 4;
+  symtab[3].st_shndx = 1;
+  symtab[4].st_name = 27;
+  symtab[4].st_info = ( STB_GLOBAL << 4 ) | STT_OBJECT;
+  symtab[4].st_value = TEST_LABEL;
+  symtab[4].st_shndx = 1;
+
+  memcpy( file + TEST_STRTAB, testStrtab, sizeof( testStrtab ) );
+
+  test_rel( file, &reltab[0], TEST_ABS_A, TEST_R_INFO( 1, TEST_R_ABS ), TEST_ADDEND );
+  test_rel( file, &reltab[1], TEST_RELATIVE, TEST_R_INFO( 0, TEST_R_RELATIVE ), TEST_DATA );
+  test_rel( file, &reltab[2], TEST_GLOB_B, TEST_R_INFO( 2, TEST_R_GLOB_DAT ), 0 );
+  test_rel( file, &jmpReltab[0], TEST_JUMP_A, TEST_R_INFO( 1, R_JUMP_SLOT ), 0 );
+  test_rel( file, &jmpReltab[1], TEST_JUMP_B, TEST_R_INFO( 2, R_JUMP_SLOT ), 0 );
+
+  dynamics->d_tag = DT_HASH;
+  ( dynamics++ )->d_un.d_ptr = TEST_HASH;
+  dynamics->d_tag = DT_STRTAB;
+  ( dynamics++ )->d_un.d_ptr = TEST_STRTAB;
+  dynamics->d_tag = DT_SYMTAB;
+  ( dynamics++ )->d_un.d_ptr = TEST_SYMTAB;
+  dynamics->d_tag = DT_STRSZ;
+  ( dynamics++ )->d_un.d_val = sizeof( testStrtab );
+  dynamics->d_tag = DT_SYMENT;
+  ( dynamics++ )->d_un.d_val = sizeof( Elf_Sym );
+  dynamics->d_tag = DT_RELTAB;
+  ( dynamics++ )->d_un.d_ptr = TEST_RELTAB;
+  dynamics->d_tag = DT_RELTABSZ;
+  ( dynamics++ )->d_un.d_val = 3 * sizeof( Elf_Rel );
+  dynamics->d_tag = DT_RELTABENT;
+  ( dynamics++ )->d_un.d_val = sizeof( Elf_Rel );
+  dynamics->d_tag = DT_JMPREL;
+  ( dynamics++ )->d_un.d_ptr = TEST_JMPRELTAB;
+  dynamics->d_tag = DT_PLTRELSZ;
+  ( dynamics++ )->d_un.d_val = 2 * sizeof( Elf_Rel );
+  dynamics->d_tag = DT_NULL;
+
+  return file;
+}
+
+/**
+ * Link memory the loader can address
+ * @param  size Byte length
+ * @return      Memory below 4 GB for ARM, or NULL if failed
+ */
+static void * test_alloc( size_t size ) {
+#if defined( MAP_32BIT ) && !defined( ELF_TARGET_AARCH64 )
+  void * const buf = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0 );
+
+  return ( buf == MAP_FAILED ? NULL : buf );
+#else
+  return ( sizeof( void * ) <= sizeof( Elf_Addr ) ? malloc( size ) : NULL );
+#endif
+}
+
+/**
+ * Opens the synthetic module with host_a and host_b mapped
+ * @param  flags ELF_RTLD_* flags
+ * @return       ELF context
+ */
+static void * test_open( int flags ) {
+  void * const handle = elf_dlmemopen( test_module(), flags );
+
+  elf_mapsym( handle, "host_a", ( void * )( uintptr_t )0xA000 );
+  elf_mapsym( handle, "host_b", ( void * )( uintptr_t )0xB000 );
+  return handle;
+}
@@ -0,0 +1,174 @@
+/*
+
+  flush.c
+
+  elf_flushf reports of linking, elf_profenable and elf_rebind
+  ranges are checked per segment tag, touching ranges with the same tag must arrive merged
+
+*/
+
+#include "elf/elf.c"
+#include "elftest.h"
+
+#define FLUSH_MAX ( 16 )
+
+typedef struct {
+  uintptr_t addr;
+  size_t    size;
+  int       flags;
+} flushCall;
+
+typedef struct {
+  flushCall calls[FLUSH_MAX];
+  int       count;
+} flushLog;
+
+/* Mock elf_flushf, records every reported range */
+static void flush_record( void * uptr, void * addr, size_t size, int flags ) {
+  flushLog * const log = ( flushLog * )uptr;
+
+  if ( log->count < FLUSH_MAX ) {
+    log->calls[log->count].addr = ( uintptr_t )addr;
+    log->calls[log->count].size = size;
+    log->calls[log->count].flags = flags;
+  }
+
+  log->count++;
+}
+
+/* Checks one recorded range against link memory offsets */
+static int flush_is( const flushLog * log, int index, uint8_t * buf, uintptr_t offset, size_t size, int flags ) {
+  return ( index < log->count && index < FLUSH_MAX &&
+           log->calls[index].addr == ( uintptr_t )buf + offset &&
+           log->calls[index].size == size &&
+           log->calls[index].flags == flags );
+}
+
+/* Code segment alone, both data segments touch and merge */
+static void test_link( void ) {
+  flushLog log = { { { 0 } }, 0 };
+  void * const handle = test_open( ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_flushcb( handle, flush_record, &log );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  TEST_CHECK( log.count == 2 );
+  TEST_CHECK( flush_is( &log, 0, buf, 0, 0x1000, ELF_FLUSH_EXEC ) );
+  TEST_CHECK( flush_is( &log, 1, buf, 0x1000, TEST_IMAGE_END - 0x1000, ELF_FLUSH_DATA ) );
+
+  /* Without a callback nothing is reported, relinking reports the same ranges again */
+  elf_flushcb( handle, NULL, NULL );
+  elf_link( handle, buf );
+  TEST_CHECK( log.count == 2 );
+
+  elf_flushcb( handle, flush_record, &log );
+  elf_link( handle, buf );
+  TEST_CHECK( log.count == 4 );
+  TEST_CHECK( flush_is( &log, 2, buf, 0, 0x1000, ELF_FLUSH_EXEC ) );
+  TEST_CHECK( flush_is( &log, 3, buf, 0x1000, TEST_IMAGE_END - 0x1000, ELF_FLUSH_DATA ) );
+
+  elf_dlclose( handle );
+}
+
+/* Profiling thunks follow the image, their code is reported apart from the data before it */
+static void test_profile( void ) {
+  flushLog log = { { { 0 } }, 0 };
+  void * const handle = test_open( ELF_RTLD_PROFILE );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_flushcb( handle, flush_record, &log );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( elf_profcount( handle ) == 2 );
+
+  TEST_CHECK( log.count == 3 );
+  TEST_CHECK( flush_is( &log, 0, buf, 0, 0x1000, ELF_FLUSH_EXEC ) );
+  TEST_CHECK( flush_is( &log, 1, buf, 0x1000, TEST_IMAGE_END - 0x1000, ELF_FLUSH_DATA ) );
+  TEST_CHECK( flush_is( &log, 2, buf, TEST_IMAGE_END, 2 * sizeof( Elf_thunk ), ELF_FLUSH_EXEC ) );
+
+  /* Both jump slots are rewritten, they are adjacent so one range covers them */
+  log.count = 0;
+  elf_profenable( handle, 0 );
+  TEST_CHECK( log.count == 1 );
+  TEST_CHECK( flush_is( &log, 0, buf, TEST_JUMP_A, 2 * sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_A ) == 0xA000 );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_B ) == 0xB000 );
+
+  log.count = 0;
+  elf_profenable( handle, 1 );
+  TEST_CHECK( log.count == 1 );
+  TEST_CHECK( flush_is( &log, 0, buf, TEST_JUMP_A, 2 * sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+
+  elf_dlclose( handle );
+}
+
+/* Rebinding reports every patched word, words apart are separate ranges */
+static void test_rebind( void ) {
+  flushLog log = { { { 0 } }, 0 };
+  void * const handle = test_open( ELF_RTLD_REBIND );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_flushcb( handle, flush_record, &log );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  log.count = 0;
+  TEST_CHECK( elf_rebind( handle, "host_a", ( void * )( uintptr_t )0xA100 ) );
+  TEST_CHECK( log.count == 2 );
+  TEST_CHECK( flush_is( &log, 0, buf, TEST_JUMP_A, sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( flush_is( &log, 1, buf, TEST_ABS_A, sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_A ) == 0xA100 );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_ABS_A ) == 0xA100 + TEST_ADDEND );
+
+  /* Unknown imports patch and report nothing */
+  log.count = 0;
+  TEST_CHECK( !elf_rebind( handle, "host_c", ( void * )( uintptr_t )0xC000 ) );
+  TEST_CHECK( log.count == 0 );
+
+  elf_dlclose( handle );
+}
+
+/* Profiled jump slots keep their thunk, only the thunk target is reported */
+static void test_rebind_profile( void ) {
+  flushLog log = { { { 0 } }, 0 };
+  void * const handle = test_open( ELF_RTLD_REBIND | ELF_RTLD_PROFILE );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_flushcb( handle, flush_record, &log );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  Elf_thunk * const thunkA = &_ELF_H( handle )->thunks[0];
+
+  log.count = 0;
+  TEST_CHECK( elf_rebind( handle, "host_a", ( void * )( uintptr_t )0xA100 ) );
+  TEST_CHECK( log.count == 2 );
+  TEST_CHECK( flush_is( &log, 0, ( uint8_t * )&thunkA->target, 0, sizeof( thunkA->target ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( flush_is( &log, 1, buf, TEST_ABS_A, sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_A ) == ( Elf_Addr )( uintptr_t )thunkA->code );
+  TEST_CHECK( thunkA->target == 0xA100 );
+
+  /* Not profiling, the jump slot is patched too */
+  elf_profenable( handle, 0 );
+  log.count = 0;
+  TEST_CHECK( elf_rebind( handle, "host_a", ( void * )( uintptr_t )0xA200 ) );
+  TEST_CHECK( log.count == 3 );
+  TEST_CHECK( flush_is( &log, 0, ( uint8_t * )&thunkA->target, 0, sizeof( thunkA->target ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( flush_is( &log, 1, buf, TEST_JUMP_A, sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( flush_is( &log, 2, buf, TEST_ABS_A, sizeof( Elf_Addr ), ELF_FLUSH_DATA ) );
+  TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_A ) == 0xA200 );
+
+  elf_dlclose( handle );
+}
+
+int main( void ) {
+  test_link();
+  test_profile();
+  test_rebind();
+  test_rebind_profile();
+
+  printf( "flush: %d failed checks\n", testFailures );
+  return ( testFailures != 0 );
+}
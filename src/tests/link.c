@@ -0,0 +1,203 @@
+/*
+
+  link.c
+
+  Relocation results of the synthetic module, built once per target
+  covers the REL (ARM) and RELA (AArch64) addend handling of every implemented relocation type
+
+*/
+
+#include "elf/elf.c"
+#include "elftest.h"
+
+#define WORD( buf, offset ) ( *( Elf_Addr * )( ( buf ) + ( offset ) ) )
+
+/* Every relocated word and the exported symbol */
+static void test_relocations( void ) {
+  void * const handle = test_open( ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( elf_lbounds( handle ) >= TEST_IMAGE_END );
+
+  memset( buf, 0xAA, elf_lbounds( handle ) );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  TEST_CHECK( WORD( buf, TEST_ABS_A ) == 0xA000 + TEST_ADDEND );
+  TEST_CHECK( WORD( buf, TEST_RELATIVE ) == ( Elf_Addr )( uintptr_t )( buf + TEST_DATA ) );
+  TEST_CHECK( WORD( buf, TEST_GLOB_B ) == 0xB000 );
+  TEST_CHECK( WORD( buf, TEST_JUMP_A ) == 0xA000 );
+  TEST_CHECK( WORD( buf, TEST_JUMP_B ) == 0xB000 );
+
+  TEST_CHECK( elf_dlsym( handle, "module_data" ) == buf + TEST_DATA );
+  TEST_CHECK( !elf_dlsym( handle, "host_c" ) );
+  elf_dlerror( handle );
+
+  /* bss is cleared, file bytes are copied */
+  TEST_CHECK( buf[TEST_IMAGE_END - 1] == 0 );
+  TEST_CHECK( !memcmp( buf + TEST_STRTAB, testStrtab, sizeof( testStrtab ) ) );
+
+  elf_dlclose( handle );
+}
+
+/* Labels inside a symbol only match their own address, addresses outside the segments match nothing */
+static void test_dladdr( void ) {
+  void * const handle = test_open( ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+  elf_syminfo info;
+
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  TEST_CHECK( elf_dladdr( handle, buf + TEST_LABEL, &info ) );
+  TEST_CHECK( !strcmp( info.sname, "module_label" ) && info.ssize == 0 );
+
+  TEST_CHECK( elf_dladdr( handle, buf + TEST_LABEL + 1, &info ) );
+  TEST_CHECK( !strcmp( info.sname, "module_data" ) && info.saddr == buf + TEST_DATA );
+
+  TEST_CHECK( elf_dladdr( handle, buf + TEST_DATA, &info ) );
+  TEST_CHECK( !strcmp( info.sname, "module_data" ) );
+
+  TEST_CHECK( !elf_dladdr( handle, buf + TEST_DATA + 4, &info ) );
+  TEST_CHECK( !elf_dladdr( handle, buf + TEST_IMAGE_END, &info ) );
+
+  elf_dlclose( handle );
+}
+
+/* Packed modules keep the segment alignment, profiling thunks (ARM) leave the first one unaligned */
+static void test_pack( void ) {
+  elf_packinfo modules[2] = { { test_open( ELF_RTLD_PROFILE ) }, { test_open( ELF_RTLD_DEFAULT ) } };
+
+  TEST_CHECK( !elf_pack( modules, 2, 24 ) );
+
+  const size_t size = elf_pack( modules, 2, 16 );
+  uint8_t * const region = ( uint8_t * )test_alloc( size );
+
+  TEST_CHECK( modules[0].offset == 0 );
+  TEST_CHECK( modules[1].offset >= modules[0].size && modules[1].offset % 0x100 == 0 );
+  TEST_CHECK( size == modules[1].offset + modules[1].size );
+
+  TEST_CHECK( elf_packlink( modules, 2, region ) == 2 );
+  TEST_CHECK( WORD( region, TEST_ABS_A ) == 0xA000 + TEST_ADDEND );
+  TEST_CHECK( WORD( region + modules[1].offset, TEST_RELATIVE ) == ( Elf_Addr )( uintptr_t )( region + modules[1].offset + TEST_DATA ) );
+
+  elf_dlclose( modules[0].handle );
+  elf_dlclose( modules[1].handle );
+}
+
+/* Linking a step at a time gives the elf_link image, whatever the budget */
+static void test_step( int flags ) {
+  void * handle = test_open( flags );
+  const size_t size = elf_lbounds( handle );
+  uint8_t * const buf = ( uint8_t * )test_alloc( size );
+  uint8_t * const linked = ( uint8_t * )malloc( size );
+  const size_t budgets[] = { 1, 3, 1000 };
+
+  memset( buf, 0xAA, size );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+  memcpy( linked, buf, size );
+  elf_dlclose( handle );
+
+  for ( size_t ii = 0; ii < sizeof( budgets ) / sizeof( budgets[0] ); ii++ ) {
+    size_t steps = 0, done, total;
+
+    handle = test_open( flags );
+    memset( buf, 0xAA, size );
+
+    while ( elf_link_step( handle, buf, budgets[ii] ) ) {
+      steps++;
+    }
+
+    TEST_CHECK( !elf_dlerror( handle ) );
+    TEST_CHECK( elf_link_progress( handle, &done, &total ) == ELF_LINK_DONE );
+    TEST_CHECK( steps >= TEST_IMAGE_END / budgets[ii] );
+
+    /* Thunks hold the handle, the rest must match byte for byte */
+    TEST_CHECK( !memcmp( buf, linked, TEST_IMAGE_END ) );
+
+    for ( Elf_Size jj = 0; jj < _ELF_H( handle )->thunkLength; jj++ ) {
+      const Elf_thunk * const thunk = &_ELF_H( handle )->thunks[jj];
+      const Elf_thunk * const expected = ( const Elf_thunk * )( linked + ( ( uint8_t * )thunk - buf ) );
+
+      TEST_CHECK( !memcmp( thunk->code, expected->code, sizeof( thunk->code ) ) && thunk->target == expected->target );
+    }
+
+    elf_dlclose( handle );
+  }
+
+  free( linked );
+}
+
+/* Mock elf_parallelf, runs the tasks backwards on the calling thread */
+static void link_parallel( void * uptr, elf_taskf task, void * ctx, size_t count ) {
+  ( void )uptr;
+
+  while ( count-- ) {
+    task( ctx, count );
+  }
+}
+
+/* Chunks of one entry, in any order, give the serial result */
+static void test_parallel( void ) {
+  void * const handle = test_open( ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_parallel( handle, link_parallel, NULL, 1 );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  TEST_CHECK( WORD( buf, TEST_ABS_A ) == 0xA000 + TEST_ADDEND );
+  TEST_CHECK( WORD( buf, TEST_RELATIVE ) == ( Elf_Addr )( uintptr_t )( buf + TEST_DATA ) );
+  TEST_CHECK( WORD( buf, TEST_GLOB_B ) == 0xB000 );
+  TEST_CHECK( WORD( buf, TEST_JUMP_B ) == 0xB000 );
+  TEST_CHECK( elf_dlsym( handle, "module_data" ) == buf + TEST_DATA );
+
+  elf_dlclose( handle );
+}
+
+/* A missing import fails the link */
+static void test_unresolved( void ) {
+  void * const handle = elf_dlmemopen( test_module(), ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_mapsym( handle, "host_a", ( void * )( uintptr_t )0xA000 );
+  elf_link( handle, buf );
+  TEST_CHECK( elf_dlerror( handle ) != NULL );
+
+  elf_dlclose( handle );
+}
+
+/* Rebinding keeps the addend of every slot */
+static void test_rebind( void ) {
+  void * const handle = test_open( ELF_RTLD_REBIND );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  TEST_CHECK( elf_rebind( handle, "host_a", ( void * )( uintptr_t )0xA100 ) );
+  TEST_CHECK( WORD( buf, TEST_ABS_A ) == 0xA100 + TEST_ADDEND );
+  TEST_CHECK( WORD( buf, TEST_JUMP_A ) == 0xA100 );
+
+  TEST_CHECK( elf_rebind( handle, "host_b", ( void * )( uintptr_t )0xB100 ) );
+  TEST_CHECK( WORD( buf, TEST_GLOB_B ) == 0xB100 );
+  TEST_CHECK( WORD( buf, TEST_JUMP_B ) == 0xB100 );
+
+  elf_dlclose( handle );
+}
+
+int main( void ) {
+  test_relocations();
+  test_dladdr();
+  test_pack();
+  test_step( ELF_RTLD_DEFAULT );
+  test_step( ELF_RTLD_PROFILE | ELF_RTLD_REBIND );
+  test_parallel();
+  test_unresolved();
+  test_rebind();
+
+  printf( "link (%s): %d failed checks\n", ( ELF_CLASS == ELFCLASS64 ? "ELF64" : "ELF32" ), testFailures );
+  return ( testFailures != 0 );
+}
@@ -0,0 +1,174 @@
+/*
+
+  lz4.c
+
+  ELF_RTLD_LZ4 sources against the plain module, ARM target only
+  the frame is the synthetic module of the ARM build, compressed with "lz4 -9" (v1.9.4)
+  it must be regenerated whenever test_module changes
+
+*/
+
+#include "elf/elf.c"
+#include "elftest.h"
+
+static const uint8_t testFrame[] = {
+  0x04, 0x22, 0x4D, 0x18, 0x64, 0x40, 0xA7, 0x23, 0x01, 0x00, 0x00, 0x84, 0x7F, 0x45, 0x4C, 0x46,
+  0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x44, 0x03, 0x00, 0x28, 0x00, 0x0E, 0x00, 0x26, 0x34, 0x00,
+  0x01, 0x00, 0x53, 0x34, 0x00, 0x20, 0x00, 0x04, 0x0C, 0x00, 0x2B, 0x01, 0x00, 0x01, 0x00, 0x12,
+  0x10, 0x04, 0x00, 0x13, 0x05, 0x1D, 0x00, 0x17, 0x01, 0x14, 0x00, 0x01, 0x01, 0x00, 0x12, 0x02,
+  0x04, 0x00, 0x18, 0x06, 0x20, 0x00, 0x13, 0x12, 0x04, 0x00, 0x43, 0x00, 0x00, 0x00, 0x80, 0x18,
+  0x00, 0x04, 0x20, 0x00, 0x17, 0x02, 0x34, 0x00, 0x04, 0x20, 0x00, 0x00, 0x04, 0x00, 0x2F, 0x04,
+  0x00, 0x01, 0x00, 0xFF, 0x40, 0x12, 0x04, 0xF5, 0x01, 0x23, 0x00, 0x05, 0x0D, 0x00, 0x00, 0x84,
+  0x01, 0xD3, 0x40, 0x03, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x0B, 0xC7,
+  0x01, 0x10, 0x11, 0x84, 0x01, 0x12, 0x04, 0xB3, 0x01, 0xD0, 0x18, 0x00, 0x00, 0x00, 0x13, 0x00,
+  0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x17, 0x38, 0x00, 0x12, 0x05, 0xAB, 0x01, 0x1F, 0x10, 0x00,
+  0x01, 0xA0, 0x00, 0x8C, 0x02, 0x1F, 0x05, 0x50, 0x00, 0x3C, 0x04, 0x01, 0x00, 0x13, 0x12, 0x24,
+  0x01, 0x08, 0x10, 0x00, 0x13, 0x0F, 0x09, 0x00, 0x11, 0x04, 0x54, 0x01, 0x30, 0x01, 0x00, 0x1B,
+  0xE7, 0x02, 0x03, 0x08, 0x03, 0x00, 0x10, 0x00, 0x0F, 0x01, 0x01, 0x5E, 0x62, 0x68, 0x6F, 0x73,
+  0x74, 0x5F, 0x61, 0x07, 0x00, 0xD4, 0x62, 0x00, 0x6D, 0x6F, 0x64, 0x75, 0x6C, 0x65, 0x5F, 0x64,
+  0x61, 0x74, 0x61, 0x0C, 0x00, 0x5F, 0x6C, 0x61, 0x62, 0x65, 0x6C, 0x80, 0x00, 0x47, 0x92, 0x11,
+  0x00, 0x00, 0x02, 0x01, 0x00, 0x00, 0x04, 0x11, 0x4C, 0x02, 0x6F, 0x08, 0x11, 0x00, 0x00, 0x15,
+  0x02, 0x00, 0x01, 0x58, 0x40, 0x10, 0x00, 0x00, 0x16, 0x80, 0x00, 0x00, 0x08, 0x00, 0x2F, 0x02,
+  0x00, 0x01, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xE9, 0x01,
+  0xA0, 0x0D, 0x1F, 0x12, 0x7B, 0x01, 0xFF, 0x63, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0xA0, 0xEA, 0x78, 0x51
+};
+
+/* Opens the frame with host_a and host_b mapped */
+static void * lz4_open( int flags ) {
+  void * const handle = elf_dlmemopen( testFrame, ELF_RTLD_LZ4 | flags );
+
+  elf_mapsym( handle, "host_a", ( void * )( uintptr_t )0xA000 );
+  elf_mapsym( handle, "host_b", ( void * )( uintptr_t )0xB000 );
+  return handle;
+}
+
+/* Links the plain module into buf, returns a copy of the image */
+static uint8_t * lz4_expected( int flags, uint8_t * buf ) {
+  void * const handle = test_open( flags );
+  uint8_t * const image = ( uint8_t * )malloc( elf_lbounds( handle ) );
+
+  memset( buf, 0xAA, elf_lbounds( handle ) );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+  memcpy( image, buf, elf_lbounds( handle ) );
+  elf_dlclose( handle );
+  return image;
+}
+
+/* The small tables are readable right after opening */
+static void test_tables( void ) {
+  const uint8_t * const file = ( const uint8_t * )test_module();
+  Elf_handle * const handle = _ELF_H( lz4_open( ELF_RTLD_DEFAULT ) );
+
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_DYNAMIC ) && !memcmp( _elf_kept( handle, _ELF_KEEP_DYNAMIC ), file + TEST_DYNAMIC, 16 * sizeof( Elf_Dyn ) ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_HASH ) && !memcmp( _elf_kept( handle, _ELF_KEEP_HASH ), file + TEST_HASH, 2 * sizeof( Elf32_Word ) ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_SYMTAB ) && !memcmp( _elf_kept( handle, _ELF_KEEP_SYMTAB ), file + TEST_SYMTAB, 5 * sizeof( Elf_Sym ) ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_STRTAB ) && !memcmp( _elf_kept( handle, _ELF_KEEP_STRTAB ), testStrtab, sizeof( testStrtab ) ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_RELTAB ) && !memcmp( _elf_kept( handle, _ELF_KEEP_RELTAB ), file + TEST_RELTAB, 3 * sizeof( Elf_Rel ) ) );
+  TEST_CHECK( _elf_kept( handle, _ELF_KEEP_JMPRELTAB ) && !memcmp( _elf_kept( handle, _ELF_KEEP_JMPRELTAB ), file + TEST_JMPRELTAB, 2 * sizeof( Elf_Rel ) ) );
+
+  elf_dlclose( handle );
+
+  /* Not a frame */
+  void * const bad = elf_dlmemopen( file, ELF_RTLD_LZ4 );
+  const char * const error = elf_dlerror( bad );
+
+  TEST_CHECK( error && !strcmp( error, "LZ4" ) );
+  elf_dlclose( bad );
+}
+
+/* Mock elf_importf, appends the import names */
+static void lz4_import( void * uptr, const elf_importinfo * info ) {
+  strcat( ( char * )uptr, info->name );
+  strcat( ( char * )uptr, info->weak ? "?" : ";" );
+}
+
+/* Imports are listed from the kept tables, without linking */
+static void test_imports( void ) {
+  void * const handle = lz4_open( ELF_RTLD_DEFAULT );
+  void * const plain = test_open( ELF_RTLD_DEFAULT );
+  char names[64] = "";
+
+  TEST_CHECK( elf_imports( handle, lz4_import, names ) == 2 );
+  TEST_CHECK( !strcmp( names, "host_a;host_b;" ) );
+  TEST_CHECK( elf_imports( plain, NULL, NULL ) == 2 );
+  TEST_CHECK( !elf_dlerror( handle ) );
+
+  /* Without kept tables the call fails instead of reporting no imports */
+  _elf_free( _ELF_H( handle ), _ELF_H( handle )->kept[_ELF_KEEP_SYMTAB].data );
+  _ELF_H( handle )->kept[_ELF_KEEP_SYMTAB].data = NULL;
+  TEST_CHECK( !elf_imports( handle, NULL, NULL ) );
+
+  const char * const error = elf_dlerror( handle );
+
+  TEST_CHECK( error && !strcmp( error, "LZ4" ) );
+
+  elf_dlclose( plain );
+  elf_dlclose( handle );
+}
+
+/* elf_link of the frame gives the image of the plain module */
+static void test_link( int flags ) {
+  void * const handle = lz4_open( flags );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+  uint8_t * const expected = lz4_expected( flags, buf );
+
+  void * const plain = test_open( flags );
+
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( elf_lbounds( handle ) == elf_lbounds( plain ) );
+  elf_dlclose( plain );
+
+  memset( buf, 0xAA, elf_lbounds( handle ) );
+  elf_link( handle, buf );
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( !memcmp( buf, expected, TEST_IMAGE_END ) );
+  TEST_CHECK( elf_dlsym( handle, "module_data" ) == buf + TEST_DATA );
+
+  if ( flags & ELF_RTLD_PROFILE ) {
+    TEST_CHECK( elf_profcount( handle ) == 2 );
+    TEST_CHECK( *( Elf_Addr * )( buf + TEST_JUMP_A ) == ( Elf_Addr )( uintptr_t )_ELF_H( handle )->thunks[0].code );
+    TEST_CHECK( _ELF_H( handle )->thunks[0].target == 0xA000 );
+  }
+
+  free( expected );
+  elf_dlclose( handle );
+}
+
+/* One byte per step pauses inside literal runs and inside matches, the image is the same */
+static void test_step( void ) {
+  void * const handle = lz4_open( ELF_RTLD_DEFAULT );
+  uint8_t * const buf = ( uint8_t * )test_alloc( elf_lbounds( handle ) );
+  uint8_t * const expected = lz4_expected( ELF_RTLD_DEFAULT, buf );
+  const Elf_lz4 * const lz4 = &_ELF_H( handle )->link.lz4;
+  int literal = 0, match = 0;
+
+  memset( buf, 0xAA, elf_lbounds( handle ) );
+
+  while ( elf_link_step( handle, buf, 1 ) ) {
+    if ( _ELF_H( handle )->link.phase == ELF_LINK_COPY ) {
+      literal |= ( lz4->literals > 0 );
+      match |= ( lz4->match > 0 );
+    }
+  }
+
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( literal && match );
+  TEST_CHECK( !memcmp( buf, expected, TEST_IMAGE_END ) );
+
+  free( expected );
+  elf_dlclose( handle );
+}
+
+int main( void ) {
+  test_tables();
+  test_imports();
+  test_link( ELF_RTLD_DEFAULT );
+  test_link( ELF_RTLD_PROFILE | ELF_RTLD_REBIND );
+  test_step();
+
+  printf( "lz4: %d failed checks\n", testFailures );
+  return ( testFailures != 0 );
+}
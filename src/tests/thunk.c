@@ -0,0 +1,192 @@
+/*
+
+  thunk.c
+
+  Profiling thunk hooks driven directly, as the thunk code would call them
+  and the pc relative immediates written by _elf_thunk_init checked against the Elf_thunk layout
+
+*/
+
+#include "elf/elf.c"
+#include "elftest.h"
+
+/* ARM reads pc as the address of the current instruction plus 8 */
+#define THUNK_PC( index ) ( ( index ) * 4 + 8 )
+
+static uint32_t clockNow = 0;
+
+/* Mock elf_clockf, the test sets the time */
+static uint32_t thunk_clock( void * uptr ) {
+  ( void )uptr;
+  return clockNow;
+}
+
+/* Links the synthetic module with profiling thunks */
+static void * thunk_open( void ) {
+  void * const handle = test_open( ELF_RTLD_PROFILE );
+
+  elf_link( handle, test_alloc( elf_lbounds( handle ) ) );
+  TEST_CHECK( !elf_dlerror( handle ) );
+  TEST_CHECK( elf_profcount( handle ) == 2 );
+  return handle;
+}
+
+/* Without a clock calls are only counted */
+static void test_count( void ) {
+  void * const handle = thunk_open();
+  Elf_thunk * const thunk = &_ELF_H( handle )->thunks[0];
+  elf_profinfo info;
+
+  for ( int ii = 0; ii < 3; ii++ ) {
+    TEST_CHECK( !thunk->enter( thunk, 0x100 ) );
+  }
+
+  TEST_CHECK( !thunk->active );
+  TEST_CHECK( elf_profstat( handle, 0, &info ) );
+  TEST_CHECK( !strcmp( info.name, "host_a" ) && info.calls == 3 && info.cycles == 0 );
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( !strcmp( info.name, "host_b" ) && info.calls == 0 );
+  TEST_CHECK( !elf_profstat( handle, 2, &info ) );
+
+  elf_dlclose( handle );
+}
+
+/* A timed call saves the return address, nested calls through the same thunk are only counted */
+static void test_nested( void ) {
+  void * const handle = thunk_open();
+  Elf_thunk * const thunk = &_ELF_H( handle )->thunks[0];
+  elf_profinfo info;
+
+  elf_profclock( handle, thunk_clock, NULL );
+
+  clockNow = 1000;
+  TEST_CHECK( thunk->enter( thunk, 0x100 ) );
+  TEST_CHECK( thunk->active );
+
+  clockNow = 1010;
+  TEST_CHECK( !thunk->enter( thunk, 0x200 ) );
+  TEST_CHECK( !thunk->enter( thunk, 0x300 ) );
+
+  clockNow = 1100;
+  TEST_CHECK( thunk->exit( thunk ) == 0x100 );
+  TEST_CHECK( !thunk->active );
+
+  TEST_CHECK( elf_profstat( handle, 0, &info ) );
+  TEST_CHECK( info.calls == 3 && info.cycles == 100 );
+
+  /* Other thunks keep their own state */
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( info.calls == 0 && info.cycles == 0 );
+
+  elf_dlclose( handle );
+}
+
+/* Cycles are a 32 bit difference, the total is 64 bit */
+static void test_wrap( void ) {
+  void * const handle = thunk_open();
+  Elf_thunk * const thunk = &_ELF_H( handle )->thunks[1];
+  elf_profinfo info;
+
+  elf_profclock( handle, thunk_clock, NULL );
+
+  clockNow = 0xFFFFFFF0;
+  TEST_CHECK( thunk->enter( thunk, 0x100 ) );
+  clockNow = 0x10;
+  TEST_CHECK( thunk->exit( thunk ) == 0x100 );
+
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( info.calls == 1 && info.cycles == 0x20 );
+
+  for ( int ii = 0; ii < 2; ii++ ) {
+    clockNow = 0x10;
+    TEST_CHECK( thunk->enter( thunk, 0x100 ) );
+    clockNow = 0xF0000010;
+    TEST_CHECK( thunk->exit( thunk ) == 0x100 );
+  }
+
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( info.calls == 3 && info.cycles == 0x1E0000020ull );
+
+  /* Statistics restart from zero, the clock and routing stay */
+  elf_profreset( handle );
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( info.calls == 0 && info.cycles == 0 );
+  TEST_CHECK( *thunk->slot == ( Elf_Addr )( uintptr_t )thunk->code );
+
+  clockNow = 0;
+  TEST_CHECK( thunk->enter( thunk, 0x100 ) );
+  clockNow = 5;
+  thunk->exit( thunk );
+  TEST_CHECK( elf_profstat( handle, 1, &info ) );
+  TEST_CHECK( info.calls == 1 && info.cycles == 5 );
+
+  elf_dlclose( handle );
+}
+
+/* A timed call that never returns (longjmp) keeps the claim until elf_profreset */
+static void test_abandon( void ) {
+  void * const handle = thunk_open();
+  Elf_thunk * const thunk = &_ELF_H( handle )->thunks[0];
+
+  elf_profclock( handle, thunk_clock, NULL );
+
+  TEST_CHECK( thunk->enter( thunk, 0x100 ) );
+  TEST_CHECK( !thunk->enter( thunk, 0x200 ) );
+  TEST_CHECK( thunk->ret == 0x100 );
+
+  elf_profreset( handle );
+  TEST_CHECK( !thunk->active );
+  TEST_CHECK( thunk->enter( thunk, 0x300 ) );
+  TEST_CHECK( thunk->exit( thunk ) == 0x300 );
+
+  elf_dlclose( handle );
+}
+
+/* Every pc relative immediate must land on the field it loads */
+static void test_code( void ) {
+  void * const handle = thunk_open();
+  const Elf_thunk * const thunk = &_ELF_H( handle )->thunks[0];
+  const uint32_t * const code = thunk->code;
+
+  TEST_CHECK( thunk->enter == _elf_thunk_enter && thunk->exit == _elf_thunk_exit );
+  TEST_CHECK( thunk->target == 0xA000 );
+
+  /* sub r0, pc, #imm8 yields the thunk itself */
+  TEST_CHECK( ( code[1] & ~0xFFu ) == ARM_SUB_R0_PC );
+  TEST_CHECK( THUNK_PC( 1 ) - ( code[1] & 0xFF ) == 0 );
+  TEST_CHECK( ( code[14] & ~0xFFu ) == ARM_SUB_R0_PC );
+  TEST_CHECK( THUNK_PC( 14 ) - ( code[14] & 0xFF ) == 0 );
+
+  /* ldr ip, [r0, #imm12] loads the C hooks, mov lr, pc returns past the bx ip */
+  TEST_CHECK( code[3] == ( ARM_LDR_IP_R0 | offsetof( Elf_thunk, enter ) ) );
+  TEST_CHECK( code[4] == ARM_MOV_LR_PC && code[5] == ARM_BX_IP && THUNK_PC( 4 ) == 6 * 4 );
+  TEST_CHECK( code[15] == ( ARM_LDR_IP_R0 | offsetof( Elf_thunk, exit ) ) );
+  TEST_CHECK( code[16] == ARM_MOV_LR_PC && code[17] == ARM_BX_IP && THUNK_PC( 16 ) == 18 * 4 );
+
+  /* ldr ip, [pc, #imm12] loads the target, bx ip interworks with Thumb targets on ARMv4T */
+  TEST_CHECK( ( code[8] & ~0xFFFu ) == ARM_LDREQ_IP_PC );
+  TEST_CHECK( THUNK_PC( 8 ) + ( code[8] & 0xFFF ) == offsetof( Elf_thunk, target ) );
+  TEST_CHECK( code[9] == ARM_BXEQ_IP );
+  TEST_CHECK( ( code[11] & ~0xFFFu ) == ARM_LDR_IP_PC );
+  TEST_CHECK( THUNK_PC( 11 ) + ( code[11] & 0xFFF ) == offsetof( Elf_thunk, target ) );
+  TEST_CHECK( code[12] == ARM_BX_IP );
+
+  /* add lr, pc, #imm8 returns the timed call to the exit sequence */
+  TEST_CHECK( ( code[10] & ~0xFFu ) == ARM_ADD_LR_PC );
+  TEST_CHECK( THUNK_PC( 10 ) + ( code[10] & 0xFF ) == 13 * 4 );
+  TEST_CHECK( code[13] == ARM_PUSH_R0_R3 );
+  TEST_CHECK( code[20] == ARM_BX_IP );
+
+  elf_dlclose( handle );
+}
+
+int main( void ) {
+  test_count();
+  test_nested();
+  test_wrap();
+  test_abandon();
+  test_code();
+
+  printf( "thunk: %d failed checks\n", testFailures );
+  return ( testFailures != 0 );
+}